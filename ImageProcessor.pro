@@ -1,4 +1,4 @@
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -8,14 +8,16 @@ CONFIG += c++17
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+include(imgcore.pri)
+
 SOURCES += \
-    imageprocessor.cpp \
     main.cpp \
-    mainwindow.cpp
+    mainwindow.cpp \
+    previewcache.cpp
 
 HEADERS += \
-    imageprocessor.h \
-    mainwindow.h
+    mainwindow.h \
+    previewcache.h
 
 FORMS += \
     mainwindow.ui
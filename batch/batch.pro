@@ -0,0 +1,20 @@
+# Пакетная обработка из командной строки (без GUI):
+#   qmake batch/batch.pro && make
+# QImage живёт в модуле gui, но QApplication/виджеты не нужны.
+
+QT       += core gui
+QT       -= widgets
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = imgbatch
+
+include(../imgcore.pri)
+
+SOURCES += \
+    main.cpp \
+    batchpipeline.cpp
+
+HEADERS += \
+    batchpipeline.h
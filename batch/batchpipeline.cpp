@@ -0,0 +1,288 @@
+#include "batchpipeline.h"
+#include "imageprocessor.h"
+#include "mappedio.h"
+#include "maskio.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// Очередь ограниченной длины между этапами. push ждёт, пока освободится место,
+// pop — пока появится элемент; когда все производители отметились через
+// producerDone() и очередь пуста, pop возвращает false.
+template<typename T>
+class BoundedQueue {
+public:
+    BoundedQueue(int capacity, int producers)
+        : capacity_(std::max(1, capacity)), producers_(producers) {}
+
+    void push(T item, double& waitMs)
+    {
+        QElapsedTimer t;
+        t.start();
+        QMutexLocker lock(&mutex_);
+        while (int(items_.size()) >= capacity_)
+            notFull_.wait(&mutex_);
+        waitMs += t.nsecsElapsed() / 1e6;
+        items_.push_back(std::move(item));
+        notEmpty_.wakeOne();
+    }
+
+    bool pop(T& item, double& waitMs)
+    {
+        QElapsedTimer t;
+        t.start();
+        QMutexLocker lock(&mutex_);
+        while (items_.empty() && producers_ > 0)
+            notEmpty_.wait(&mutex_);
+        waitMs += t.nsecsElapsed() / 1e6;
+        if (items_.empty()) return false;
+        item = std::move(items_.front());
+        items_.pop_front();
+        notFull_.wakeOne();
+        return true;
+    }
+
+    void producerDone()
+    {
+        QMutexLocker lock(&mutex_);
+        if (--producers_ == 0) notEmpty_.wakeAll();
+    }
+
+private:
+    QMutex mutex_;
+    QWaitCondition notFull_, notEmpty_;
+    std::deque<T> items_;
+    const int capacity_;
+    int producers_;
+};
+
+struct Frame {
+    int index = -1;   // номер задания
+    QImage image;
+    QByteArray report;   // текст InspectFn для файла .csv
+};
+
+// Общее состояние прогона: статистика этапов сливается сюда по завершении потоков
+struct Shared {
+    QMutex mutex;
+    Batch::Stats stats;
+
+    void merge(Batch::StageStats& dst, const Batch::StageStats& part)
+    {
+        QMutexLocker lock(&mutex);
+        dst.items    += part.items;
+        dst.failures += part.failures;
+        dst.pixels   += part.pixels;
+        dst.bytes    += part.bytes;
+        dst.busyMs   += part.busyMs;
+        dst.waitMs   += part.waitMs;
+    }
+
+    void error(const QString& message)
+    {
+        QMutexLocker lock(&mutex);
+        stats.errors << message;
+    }
+};
+
+double elapsedMs(const QElapsedTimer& t) { return t.nsecsElapsed() / 1e6; }
+
+} // namespace
+
+namespace Batch {
+
+double StageStats::megapixelsPerSecond() const
+{
+    if (busyMs <= 0.0) return 0.0;
+    return (pixels / 1e6) / (busyMs / 1000.0) * std::max(1, workers);
+}
+
+Stats run(const QVector<Job>& jobs, const ProcessFn& process, const Options& options)
+{
+    const int decoders   = std::max(1, options.decoders);
+    const int processors = std::max(1, options.processors);
+    const int encoders   = std::max(1, options.encoders);
+
+    Shared shared;
+    shared.stats.decode.workers  = decoders;
+    shared.stats.process.workers = processors;
+    shared.stats.encode.workers  = encoders;
+
+    BoundedQueue<Frame> decoded(options.queueDepth, decoders);
+    BoundedQueue<Frame> processed(options.queueDepth, processors);
+    std::atomic<int> nextJob{0};
+
+    QElapsedTimer wall;
+    wall.start();
+
+    // Чтение: задания раздаются по счётчику, в очередь попадает уже серое изображение
+    auto decodeWorker = [&] {
+        StageStats part;
+        for (;;) {
+            const int i = nextJob.fetch_add(1);
+            if (i >= jobs.size()) break;
+            QElapsedTimer t;
+            t.start();
+            // PGM/PBM отображаются в память без декодирования, остальное читает QImageReader
+            QImage img = Img::mapImage(jobs[i].input);
+            QString readError;
+            if (img.isNull()) {
+                QImageReader reader(jobs[i].input);
+                img = reader.read();
+                readError = reader.errorString();
+            }
+            if (img.isNull()) {
+                part.failures++;
+                part.busyMs += elapsedMs(t);
+                shared.error(QString("%1: %2").arg(jobs[i].input, readError));
+                continue;
+            }
+            Frame f;
+            f.index = i;
+            f.image = Img::toGrayscale(img);
+            part.items++;
+            part.pixels += qint64(f.image.width()) * f.image.height();
+            part.bytes  += QFileInfo(jobs[i].input).size();
+            part.busyMs += elapsedMs(t);
+            decoded.push(std::move(f), part.waitMs);
+        }
+        decoded.producerDone();
+        shared.merge(shared.stats.decode, part);
+    };
+
+    auto processWorker = [&] {
+        StageStats part;
+        Frame f;
+        while (decoded.pop(f, part.waitMs)) {
+            QElapsedTimer t;
+            t.start();
+            const qint64 pixels = qint64(f.image.width()) * f.image.height();
+            f.image = process(f.image);
+            if (!f.image.isNull() && options.inspect) f.report = options.inspect(f.image);
+            part.busyMs += elapsedMs(t);
+            if (f.image.isNull()) {
+                part.failures++;
+                shared.error(QString("%1: ошибка обработки").arg(jobs[f.index].input));
+                continue;
+            }
+            part.items++;
+            part.pixels += pixels;
+            processed.push(std::move(f), part.waitMs);
+        }
+        processed.producerDone();
+        shared.merge(shared.stats.process, part);
+    };
+
+    auto encodeWorker = [&] {
+        StageStats part;
+        Frame f;
+        while (processed.pop(f, part.waitMs)) {
+            QElapsedTimer t;
+            t.start();
+            const QString& path = jobs[f.index].output;
+            QDir().mkpath(QFileInfo(path).absolutePath());
+            // PGM/PBM пишутся прямо в отображение файла; прочие маски — 1 бит
+            // на пиксель через saveMask (PNG/TIFF)
+            if (Img::isMappedSuffix(path) || f.image.format() == QImage::Format_MonoLSB) {
+                const bool ok = Img::isMappedSuffix(path) ? Img::saveMapped(f.image, path)
+                                                          : Img::saveMask(f.image, path);
+                if (!ok) {
+                    part.failures++;
+                    part.busyMs += elapsedMs(t);
+                    shared.error(QString("%1: ошибка записи").arg(path));
+                    continue;
+                }
+            } else {
+                QImageWriter writer(path);
+                if (!writer.write(f.image)) {
+                    part.failures++;
+                    part.busyMs += elapsedMs(t);
+                    shared.error(QString("%1: %2").arg(path, writer.errorString()));
+                    continue;
+                }
+            }
+            if (!f.report.isEmpty()) {
+                const QFileInfo info(path);
+                QFile report(info.dir().filePath(info.completeBaseName() + ".csv"));
+                if (!report.open(QFile::WriteOnly | QFile::Truncate) || report.write(f.report) != f.report.size()) {
+                    part.failures++;
+                    part.busyMs += elapsedMs(t);
+                    shared.error(QString("%1: ошибка записи").arg(report.fileName()));
+                    continue;
+                }
+                part.bytes += f.report.size();
+            }
+            part.items++;
+            part.pixels += qint64(f.image.width()) * f.image.height();
+            part.bytes  += QFileInfo(path).size();
+            part.busyMs += elapsedMs(t);
+        }
+        shared.merge(shared.stats.encode, part);
+    };
+
+    std::vector<std::unique_ptr<QThread>> threads;
+    for (int i=0; i<decoders; ++i)   threads.emplace_back(QThread::create(decodeWorker));
+    for (int i=0; i<processors; ++i) threads.emplace_back(QThread::create(processWorker));
+    for (int i=0; i<encoders; ++i)   threads.emplace_back(QThread::create(encodeWorker));
+    for (auto& t : threads) t->start();
+    for (auto& t : threads) t->wait();
+
+    shared.stats.wallMs = elapsedMs(wall);
+    return shared.stats;
+}
+
+QString report(const Stats& stats)
+{
+    struct Row { const char* name; const StageStats* s; };
+    const Row rows[] = {
+        { "чтение",    &stats.decode },
+        { "обработка", &stats.process },
+        { "запись",    &stats.encode },
+    };
+
+    QString out = QString("%1%2%3%4%5%6%7%8\n")
+        .arg("этап", -11).arg("потоков", 8).arg("готово", 8).arg("ошибок", 8)
+        .arg("Мп", 10).arg("занято, мс", 12).arg("ожидание, мс", 14).arg("Мп/с", 10);
+
+    const Row* slowest = nullptr;
+    for (const Row& r : rows) {
+        out += QString("%1%2%3%4%5%6%7%8\n")
+            .arg(r.name, -11)
+            .arg(r.s->workers, 8).arg(r.s->items, 8).arg(r.s->failures, 8)
+            .arg(r.s->pixels / 1e6, 10, 'f', 1)
+            .arg(r.s->busyMs, 12, 'f', 1)
+            .arg(r.s->waitMs, 14, 'f', 1)
+            .arg(r.s->megapixelsPerSecond(), 10, 'f', 1);
+        if (r.s->items > 0 && (!slowest || r.s->megapixelsPerSecond() < slowest->s->megapixelsPerSecond()))
+            slowest = &r;
+    }
+
+    const double sec = stats.wallMs / 1000.0;
+    const int done = stats.encode.items;
+    out += QString("\nВсего: %1 изобр. за %2 с — %3 изобр./с, %4 Мп/с")
+        .arg(done).arg(sec, 0, 'f', 2)
+        .arg(sec > 0 ? done / sec : 0.0, 0, 'f', 1)
+        .arg(sec > 0 ? stats.encode.pixels / 1e6 / sec : 0.0, 0, 'f', 1);
+    if (slowest)
+        out += QString("; узкое место: %1").arg(slowest->name);
+    out += QString("\nПрочитано %1 МБ, записано %2 МБ\n")
+        .arg(stats.decode.bytes / 1048576.0, 0, 'f', 1)
+        .arg(stats.encode.bytes / 1048576.0, 0, 'f', 1);
+    return out;
+}
+
+} // namespace Batch
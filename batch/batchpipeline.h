@@ -0,0 +1,63 @@
+#pragma once
+
+#include <QImage>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <functional>
+
+// Конвейер пакетной обработки: чтение → обработка → запись результата.
+// Каждый этап работает в своих потоках, этапы связаны очередями ограниченной
+// длины: пока одно изображение обрабатывается, следующие уже декодируются,
+// а предыдущие сжимаются и пишутся на диск. Ограничение очередей держит
+// в памяти не больше queueDepth изображений на этап, сколько бы файлов ни было.
+namespace Batch {
+
+struct Job {
+    QString input;    // исходный файл
+    QString output;   // куда писать результат (формат — по расширению)
+};
+
+// Обработка одного изображения: на вход — серое изображение (Grayscale8).
+// Маску в Format_MonoLSB конвейер пишет с 1 битом на пиксель (Img::saveMask);
+// PGM/PBM читаются и пишутся через отображение файла в память (mappedio.h).
+using ProcessFn = std::function<QImage(const QImage& gray)>;
+
+// Разбор результата на этапе обработки (например, компоненты маски): непустой
+// текст пишется рядом с результатом — то же имя, расширение .csv
+using InspectFn = std::function<QByteArray(const QImage& result)>;
+
+struct Options {
+    int decoders = 2;     // потоков чтения/декодирования
+    int processors = 1;   // потоков обработки (каждая операция Img и так параллельна)
+    int encoders = 2;     // потоков сжатия/записи
+    int queueDepth = 4;   // максимум изображений в каждой очереди между этапами
+    InspectFn inspect;    // необязательный разбор результата
+};
+
+// Статистика одного этапа
+struct StageStats {
+    int workers = 0;
+    int items = 0;          // успешно обработано
+    int failures = 0;
+    qint64 pixels = 0;      // сумма пикселей обработанных изображений
+    qint64 bytes = 0;       // прочитано/записано байт (для чтения и записи)
+    double busyMs = 0.0;    // суммарное время полезной работы всех потоков этапа
+    double waitMs = 0.0;    // суммарное время ожидания очередей
+
+    // Пропускная способность этапа (Мп/с), если все его потоки заняты без простоев
+    double megapixelsPerSecond() const;
+};
+
+struct Stats {
+    StageStats decode, process, encode;
+    double wallMs = 0.0;    // полное время работы конвейера
+    QStringList errors;     // сообщения о файлах, которые не удалось прочитать/записать
+};
+
+Stats run(const QVector<Job>& jobs, const ProcessFn& process, const Options& options);
+
+// Итоговая таблица по этапам для вывода в консоль
+QString report(const Stats& stats);
+
+} // namespace Batch
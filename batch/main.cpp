@@ -0,0 +1,391 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QTextStream>
+#include <QtMath>
+#include <algorithm>
+#include <cstdio>
+#include "imageprocessor.h"
+#include "batchpipeline.h"
+#include "pipeline.h"
+#include "stream.h"
+
+// Пакетная обработка каталога или списка файлов одной операцией Img.
+// Пример:
+//   imgbatch --op sobel --threshold 90 -o out/ scans/
+//   imgbatch --op alpha --window 31 --alpha 0.6 -o out/ --list files.txt
+//   imgbatch --stream --op alpha --window 101 -o out/ aerial.pgm
+
+namespace {
+
+// Расширения, которые умеет читать установленный Qt
+QStringList imageFilters()
+{
+    QStringList filters;
+    for (const QByteArray& fmt : QImageReader::supportedImageFormats())
+        filters << "*." + QString::fromLatin1(fmt);
+    return filters;
+}
+
+QString outputPath(const QDir& outDir, const QString& relative, const QString& suffix)
+{
+    const QFileInfo fi(relative);
+    const QString dir = fi.path() == "." ? QString() : fi.path() + "/";
+    return outDir.filePath(dir + fi.completeBaseName() + "." + suffix);
+}
+
+// Задания по каталогам/файлам; для каталогов сохраняется относительный путь
+QVector<Batch::Job> collectJobs(const QStringList& inputs, const QDir& outDir, bool recursive,
+                                const QStringList& filters, const QString& suffix)
+{
+    QVector<Batch::Job> jobs;
+    for (const QString& in : inputs) {
+        const QFileInfo fi(in);
+        if (fi.isDir()) {
+            const QDir root(fi.absoluteFilePath());
+            QDirIterator it(root.path(), filters, QDir::Files,
+                            recursive ? QDirIterator::Subdirectories : QDirIterator::NoIteratorFlags);
+            QStringList files;
+            while (it.hasNext()) files << it.next();
+            files.sort();
+            for (const QString& f : files)
+                jobs.push_back({ f, outputPath(outDir, root.relativeFilePath(f), suffix) });
+        } else {
+            jobs.push_back({ fi.filePath(), outputPath(outDir, fi.fileName(), suffix) });
+        }
+    }
+    return jobs;
+}
+
+QStringList readList(const QString& path)
+{
+    QStringList lines;
+    QFile f(path);
+    if (!f.open(QFile::ReadOnly | QFile::Text)) return lines;
+    QTextStream ts(&f);
+    while (!ts.atEnd()) {
+        const QString line = ts.readLine().trimmed();
+        if (!line.isEmpty() && !line.startsWith('#')) lines << line;
+    }
+    return lines;
+}
+
+// Таблица компонент: метка, площадь, прямоугольник, центр масс
+QByteArray componentsCsv(const Img::Components& comps)
+{
+    QByteArray csv = "label,area,x,y,width,height,cx,cy\n";
+    for (int i = 0; i < comps.count(); ++i) {
+        const Img::Component& c = comps.list[size_t(i)];
+        csv += QString("%1,%2,%3,%4,%5,%6,%7,%8\n")
+                   .arg(i + 1).arg(c.area)
+                   .arg(c.bounds.x()).arg(c.bounds.y()).arg(c.bounds.width()).arg(c.bounds.height())
+                   .arg(c.centroid.x(), 0, 'f', 2).arg(c.centroid.y(), 0, 'f', 2)
+                   .toLatin1();
+    }
+    return csv;
+}
+
+// Таблица отрезков Хафа: ρ, θ в градусах, голоса и концы отрезка
+QByteArray houghCsv(const std::vector<Img::HoughLine>& lines)
+{
+    QByteArray csv = "rho,theta,votes,x1,y1,x2,y2\n";
+    for (const Img::HoughLine& l : lines)
+        csv += QString("%1,%2,%3,%4,%5,%6,%7\n")
+                   .arg(l.rho, 0, 'f', 0).arg(qRadiansToDegrees(l.theta), 0, 'f', 2).arg(l.votes)
+                   .arg(l.p1.x(), 0, 'f', 1).arg(l.p1.y(), 0, 'f', 1)
+                   .arg(l.p2.x(), 0, 'f', 1).arg(l.p2.y(), 0, 'f', 1)
+                   .toLatin1();
+    return csv;
+}
+
+// Потоковый режим: файлы по очереди, каждый — полосами через Img::processStream,
+// так что в памяти держится несколько полос, а не изображение целиком
+int runStream(const QVector<Batch::Job>& jobs, const Img::StreamOp& op, const QSize& raw,
+              int stripRows, Img::FileStripSink::Format format, QTextStream& out, QTextStream& err)
+{
+    int failures = 0;
+    qint64 pixels = 0;
+    QElapsedTimer wall;
+    wall.start();
+    for (const Batch::Job& job : jobs) {
+        const std::unique_ptr<Img::FileStripSource> src = raw.isEmpty()
+            ? Img::FileStripSource::openPgm(job.input)
+            : Img::FileStripSource::openRaw(job.input, raw.width(), raw.height());
+        if (!src) {
+            err << job.input << ": не удалось открыть (нужен PGM P5 или сырой файл --raw)\n";
+            ++failures;
+            continue;
+        }
+        QDir().mkpath(QFileInfo(job.output).absolutePath());
+        const std::unique_ptr<Img::FileStripSink> dst =
+            Img::FileStripSink::create(job.output, format, src->width(), src->height());
+        if (!dst || !Img::processStream(*src, *dst, op, stripRows)) {
+            err << job.output << ": ошибка обработки или записи\n";
+            ++failures;
+            continue;
+        }
+        pixels += qint64(src->width()) * src->height();
+    }
+    const double sec = std::max<qint64>(1, wall.elapsed()) / 1000.0;
+    out << "Обработано: " << jobs.size() - failures << " из " << jobs.size()
+        << ", " << QString::number(pixels / 1e6, 'f', 1) << " Мп за " << QString::number(sec, 'f', 2)
+        << " с (" << QString::number(pixels / 1e6 / sec, 'f', 1) << " Мп/с)\n";
+    return failures ? 1 : 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("imgbatch");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Пакетная обработка изображений (операции ImageProcessor)");
+    parser.addHelpOption();
+    parser.addPositionalArgument("inputs", "Файлы и/или каталоги с изображениями", "[inputs...]");
+
+    const QCommandLineOption opOpt("op",
+        "Операция: gray, otsu, mean, iterative, alpha, niblack, sauvola, wolf, bradley, "
+        "sobel, lines, points, canny (по умолчанию otsu).",
+        "name", "otsu");
+    const QCommandLineOption outOpt(QStringList{ "o", "output" }, "Каталог для результатов.", "dir");
+    const QCommandLineOption formatOpt("format",
+        "Формат результатов: png, pbm, pgm, tif (по умолчанию png; с --stream — pbm или pgm, по умолчанию pbm). "
+        "Маски пишутся с 1 битом на пиксель, PGM/PBM — прямо в отображение файла.",
+        "name", "png");
+    const QCommandLineOption listOpt(QStringList{ "l", "list" }, "Файл со списком входных изображений (по одному на строку).", "file");
+    const QCommandLineOption recOpt(QStringList{ "r", "recursive" }, "Обходить подкаталоги.");
+    const QCommandLineOption thOpt("threshold", "Порог для sobel/lines/points (по умолчанию 100/120/150); "
+                                                "для canny — верхний (по умолчанию 120).", "n");
+    const QCommandLineOption lowOpt("low", "Нижний порог canny (по умолчанию 50).", "n", "50");
+    const QCommandLineOption sigmaOpt("sigma", "Гауссово сглаживание перед sobel/lines/points/canny (σ, 0 — без него).", "s", "0");
+    const QCommandLineOption medianOpt("median", "Медианный фильтр радиуса r перед операцией (0 — без него, до 255).", "r", "0");
+    const QCommandLineOption winOpt("window", "Размер окна адаптивных методов (нечётный, 3..1001).", "n", "25");
+    const QCommandLineOption alphaOpt("alpha", "Параметр α (0.3..0.8).", "a", "0.67");
+    const QCommandLineOption kOpt("k", "Параметр k для niblack/sauvola/wolf/bradley "
+                                       "(по умолчанию -0.2/0.34/0.5/0.15).", "k");
+    const QCommandLineOption threadsOpt("threads", "Потоков для операций Img (0 — по числу ядер).", "n", "0");
+    const QCommandLineOption decOpt("decoders", "Потоков чтения.", "n", "2");
+    const QCommandLineOption procOpt("processors", "Потоков обработки.", "n", "1");
+    const QCommandLineOption encOpt("encoders", "Потоков записи PNG.", "n", "2");
+    const QCommandLineOption queueOpt("queue", "Длина очереди между этапами (изображений).", "n", "4");
+    const QCommandLineOption streamOpt("stream",
+        "Потоковая обработка полосами для изображений больше памяти: вход — PGM (P5) "
+        "или сырой 8-битный файл (--raw), результат — PBM или PGM (--format).");
+    const QCommandLineOption rawOpt("raw", "Входные файлы — сырой 8-битный растр без заголовка размером WxH.", "WxH");
+    const QCommandLineOption stripOpt("strip", "Строк в полосе потоковой обработки.", "n", "256");
+    const QCommandLineOption morphOpt("morph", "Очистка маски после операции: erode, dilate, open, close "
+                                               "(над белыми пикселями).", "name");
+    const QCommandLineOption seOpt("se", "Размер структурного элемента --morph, WxH или N.", "WxH", "3");
+    const QCommandLineOption crossOpt("cross", "Элемент --morph — крест вместо прямоугольника.");
+    const QCommandLineOption compOpt("components",
+        "Разметить связные компоненты маски и записать рядом с результатом <имя>.csv "
+        "(площадь, прямоугольник, центр масс). Объекты пороговых методов — чёрные, детекторов — белые.");
+    const QCommandLineOption houghOpt("hough",
+        "Найти на маске sobel/lines/points/canny отрезки прямых (преобразование Хафа) "
+        "и записать рядом с результатом <имя>.csv (ρ, θ, голоса, концы).");
+    const QCommandLineOption houghLenOpt("hough-length", "Минимальная длина отрезка --hough и число голосов за прямую.", "n", "30");
+    parser.addOptions({ opOpt, outOpt, formatOpt, listOpt, recOpt, thOpt, lowOpt, sigmaOpt, medianOpt, winOpt, alphaOpt, kOpt,
+                        threadsOpt, decOpt, procOpt, encOpt, queueOpt, streamOpt, rawOpt, stripOpt, morphOpt, seOpt, crossOpt, compOpt,
+                        houghOpt, houghLenOpt });
+    parser.process(app);
+
+    QTextStream err(stderr);
+    QTextStream out(stdout);
+
+    if (!parser.isSet(outOpt)) {
+        err << "Не задан каталог результатов (-o).\n";
+        return 2;
+    }
+
+    QStringList inputs = parser.positionalArguments();
+    if (parser.isSet(listOpt)) inputs << readList(parser.value(listOpt));
+    if (inputs.isEmpty()) {
+        err << "Нет входных файлов.\n";
+        return 2;
+    }
+
+    const bool stream = parser.isSet(streamOpt);
+    const QString format = parser.isSet(formatOpt) ? parser.value(formatOpt).toLower()
+                                                   : QString(stream ? "pbm" : "png");
+    const QStringList formats = stream ? QStringList{ "pbm", "pgm" } : QStringList{ "png", "pbm", "pgm", "tif" };
+    if (!formats.contains(format)) {
+        err << "Формат " << format << " не поддерживается, доступны: " << formats.join(", ") << "\n";
+        return 2;
+    }
+
+    QSize raw;
+    if (parser.isSet(rawOpt)) {
+        const QStringList wh = parser.value(rawOpt).toLower().split('x');
+        if (wh.size() == 2) raw = QSize(wh[0].toInt(), wh[1].toInt());
+        if (!stream || raw.isEmpty()) {
+            err << "--raw WxH задаёт размер сырых файлов и работает только с --stream.\n";
+            return 2;
+        }
+    }
+
+    // Операция с параметрами — как в главном окне; маски сразу упакованные
+    const QString op = parser.value(opOpt);
+    const bool hasTh = parser.isSet(thOpt);
+    const int th = parser.value(thOpt).toInt();
+    const int window = parser.value(winOpt).toInt();
+    const double alpha = parser.value(alphaOpt).toDouble();
+    const Img::DetectorThresholds defaults;
+
+    Img::StreamOp streamOp;
+    streamOp.windowSize = window;
+    streamOp.alpha = alpha;
+    bool streamable = true;
+
+    // Медиана и сглаживание — этапы конвейера перед операцией
+    const int median = parser.value(medianOpt).toInt();
+    if (median < 0 || median > Img::kMaxMedianRadius) {
+        err << "--median: радиус от 0 до " << Img::kMaxMedianRadius << ".\n";
+        return 2;
+    }
+    const double sigma = parser.value(sigmaOpt).toDouble();
+    if (sigma > 0 && op != "sobel" && op != "lines" && op != "points" && op != "canny") {
+        err << "--sigma работает только с sobel/lines/points/canny.\n";
+        return 2;
+    }
+    Img::Pipeline pipeline;
+    if (median > 0) pipeline.median(median);
+    if (sigma > 0) pipeline.gaussian(sigma);
+    if (median > 0 || sigma > 0) streamable = false;
+
+    // Операция — следующий этап; глобальным методам и Канни нужно всё изображение
+    const QStringList localOps{ "niblack", "sauvola", "wolf", "bradley" };
+    if (op == "gray") {
+        streamable = false;
+    } else if (op == "otsu") {
+        pipeline.stage(0, [](const QImage& g) { return Img::thresholdOtsu(g); }, true);
+        streamOp.kind = Img::StreamOp::Otsu;
+    } else if (op == "mean") {
+        pipeline.stage(0, [](const QImage& g) { return Img::thresholdMean(g); }, true);
+        streamOp.kind = Img::StreamOp::Mean;
+    } else if (op == "iterative") {
+        pipeline.stage(0, [](const QImage& g) { return Img::thresholdIterative(g); }, true);
+        streamOp.kind = Img::StreamOp::Iterative;
+    } else if (op == "alpha") {
+        if (window < 3 || window > 1001 || window % 2 == 0) {
+            err << "Размер окна должен быть нечётным числом от 3 до 1001.\n";
+            return 2;
+        }
+        pipeline.stage(window / 2, [=](const QImage& g) { return Img::adaptiveAlpha(g, window, alpha); });
+        streamOp.kind = Img::StreamOp::Alpha;
+    } else if (localOps.contains(op)) {
+        if (window < 3 || window > 1001 || window % 2 == 0) {
+            err << "Размер окна должен быть нечётным числом от 3 до 1001.\n";
+            return 2;
+        }
+        const auto method = Img::LocalMethod(localOps.indexOf(op));
+        const double k = parser.isSet(kOpt) ? parser.value(kOpt).toDouble() : Img::localDefaultK(method);
+        // Вульф нормирует по всему изображению
+        pipeline.stage(window / 2, [=](const QImage& g) { return Img::thresholdLocal(g, method, window, k); },
+                       method == Img::LocalMethod::Wolf);
+        streamable = false;
+    } else if (op == "sobel") {
+        const int t = hasTh ? th : defaults.sobel;
+        pipeline.response(Img::DetectSobel).threshold(t);
+        streamOp.kind = Img::StreamOp::Sobel;
+        streamOp.threshold = t;
+    } else if (op == "lines") {
+        const int t = hasTh ? th : defaults.lines;
+        pipeline.response(Img::DetectLines).threshold(t);
+        streamOp.kind = Img::StreamOp::Lines;
+        streamOp.threshold = t;
+    } else if (op == "points") {
+        const int t = hasTh ? th : defaults.points;
+        pipeline.response(Img::DetectPoints).threshold(t);
+        streamOp.kind = Img::StreamOp::Points;
+        streamOp.threshold = t;
+    } else if (op == "canny") {
+        // Гистерезис связывает границы через всё изображение — полосами не считается
+        const int high = hasTh ? th : 120;
+        const int low = parser.value(lowOpt).toInt();
+        pipeline.stage(2, [=](const QImage& g) { return Img::edgesCanny(g, low, high); }, true);
+        streamable = false;
+    } else {
+        err << "Неизвестная операция: " << op << "\n";
+        return 2;
+    }
+    if (parser.isSet(morphOpt)) {
+        const QStringList morphOps{ "erode", "dilate", "open", "close" };
+        const QStringList se = parser.value(seOpt).toLower().split('x');
+        const int sw = se.value(0).toInt();
+        const int sh = se.size() > 1 ? se.value(1).toInt() : sw;
+        if (!morphOps.contains(parser.value(morphOpt)) || op == "gray" || sw < 1 || sh < 1) {
+            err << "--morph: erode|dilate|open|close после операции, дающей маску; --se WxH — положительные размеры.\n";
+            return 2;
+        }
+        const auto shape = parser.isSet(crossOpt) ? Img::StructShape::Cross : Img::StructShape::Rect;
+        pipeline.morphology(Img::MorphOp(morphOps.indexOf(parser.value(morphOpt))), sw, sh, shape);
+        streamable = false;
+    }
+    // Маски сразу упакованные; серое (gray, в том числе после медианы) остаётся серым
+    const Img::MaskFormat maskFormat = op == "gray" ? Img::MaskFormat::Gray8 : Img::MaskFormat::Mono;
+    const Batch::ProcessFn process = [pipeline, maskFormat](const QImage& g) { return pipeline.run(g, maskFormat); };
+    if (parser.isSet(compOpt) && (op == "gray" || stream)) {
+        err << "--components работает только с операциями, дающими маску, и без --stream.\n";
+        return 2;
+    }
+    const bool detector = op == "sobel" || op == "lines" || op == "points" || op == "canny";
+    if (parser.isSet(houghOpt) && (!detector || stream || parser.isSet(compOpt))) {
+        err << "--hough работает только с sobel/lines/points/canny, без --stream и --components.\n";
+        return 2;
+    }
+    if (stream && !streamable) {
+        err << "Операция " << op << " в потоковом режиме не поддерживается.\n";
+        return 2;
+    }
+
+    Img::setThreadCount(parser.value(threadsOpt).toInt());
+
+    const QDir outDir(parser.value(outOpt));
+    const QStringList filters = !stream ? imageFilters() : QStringList{ raw.isEmpty() ? "*.pgm" : "*.raw" };
+    const QVector<Batch::Job> jobs = collectJobs(inputs, outDir, parser.isSet(recOpt), filters, format);
+    if (jobs.isEmpty()) {
+        err << "Во входных каталогах нет изображений.\n";
+        return 2;
+    }
+
+    if (stream) {
+        out << "Изображений: " << jobs.size() << ", операция: " << op << ", потоковый режим, полоса "
+            << parser.value(stripOpt) << " строк, потоков Img: " << Img::threadCount() << "\n";
+        out.flush();
+        return runStream(jobs, streamOp, raw, parser.value(stripOpt).toInt(),
+                         format == "pgm" ? Img::FileStripSink::Pgm : Img::FileStripSink::Pbm, out, err);
+    }
+
+    Batch::Options options;
+    options.decoders   = parser.value(decOpt).toInt();
+    options.processors = parser.value(procOpt).toInt();
+    options.encoders   = parser.value(encOpt).toInt();
+    options.queueDepth = parser.value(queueOpt).toInt();
+    if (parser.isSet(compOpt)) {
+        // объекты детекторов — белые отклики, пороговых методов — чёрный текст
+        options.inspect = [detector](const QImage& mask) { return componentsCsv(Img::labelComponents(mask, detector)); };
+    }
+    if (parser.isSet(houghOpt)) {
+        Img::HoughParams params;
+        params.minLength = params.minVotes = std::max(1, parser.value(houghLenOpt).toInt());
+        options.inspect = [params](const QImage& mask) { return houghCsv(Img::houghLines(mask, params)); };
+    }
+
+    out << "Изображений: " << jobs.size() << ", операция: " << op
+        << ", потоков Img: " << Img::threadCount() << "\n";
+    out.flush();
+
+    const Batch::Stats stats = Batch::run(jobs, process, options);
+
+    for (const QString& e : stats.errors) err << e << "\n";
+    out << "\n" << Batch::report(stats);
+
+    return stats.errors.isEmpty() ? 0 : 1;
+}
@@ -0,0 +1,22 @@
+# Замеры производительности всех операций Img на синтетических изображениях:
+#   qmake bench/bench.pro && make
+#   imgbench --json results.json
+
+QT       += core gui
+QT       -= widgets
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = imgbench
+
+include(../imgcore.pri)
+
+SOURCES += \
+    main.cpp \
+    synthetic.cpp
+
+HEADERS += \
+    synthetic.h
+
+win32: LIBS += -lpsapi
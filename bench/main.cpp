@@ -0,0 +1,408 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QTextStream>
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include "imageprocessor.h"
+#include "pipeline.h"
+#include "simdkernels.h"
+#include "synthetic.h"
+
+#if defined(Q_OS_WIN)
+#  include <windows.h>
+#  include <psapi.h>
+#elif defined(Q_OS_UNIX)
+#  include <sys/resource.h>
+#endif
+
+// Замеры всех операций Img на синтетических изображениях.
+// Каждый случай (операция × параметры × содержимое × размер) запускается
+// --reps раз; в отчёт идут минимальное и медианное время, Мп/с по медиане и
+// пиковая память процесса. Результаты пишутся в JSON (--json) и могут быть
+// сравнены с прошлым прогоном (--compare): рост медианного времени больше
+// --tolerance процентов считается регрессией и даёт код возврата 1.
+
+namespace {
+
+// ---------------- Память ----------------
+
+// Пиковый размер резидентной памяти процесса в байтах (0 — неизвестно)
+qint64 peakRssBytes()
+{
+#if defined(Q_OS_LINUX)
+    QFile f("/proc/self/status");
+    if (f.open(QFile::ReadOnly | QFile::Text)) {
+        for (const QByteArray& line : f.readAll().split('\n'))
+            if (line.startsWith("VmHWM:"))
+                return line.mid(6).trimmed().split(' ').value(0).toLongLong() * 1024;
+    }
+    return 0;
+#elif defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return qint64(pmc.PeakWorkingSetSize);
+    return 0;
+#elif defined(Q_OS_UNIX)
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#  if defined(Q_OS_MACOS)
+    return qint64(ru.ru_maxrss);          // байты
+#  else
+    return qint64(ru.ru_maxrss) * 1024;   // килобайты
+#  endif
+#else
+    return 0;
+#endif
+}
+
+// Сбросить пик, чтобы следующий замер показал память своего случая.
+// Умеет только Linux (clear_refs = 5); на остальных системах пик общий на процесс.
+bool resetPeakRss()
+{
+#if defined(Q_OS_LINUX)
+    QFile f("/proc/self/clear_refs");
+    return f.open(QFile::WriteOnly) && f.write("5") == 1;
+#else
+    return false;
+#endif
+}
+
+// ---------------- Случаи ----------------
+
+// Входные данные одного размера/содержимого; производные считаются заранее,
+// чтобы не попадать в замер чужих операций
+struct Input {
+    QImage gray;
+    QImage rgb;                 // для toGrayscale
+    Img::ImageStats stats;
+    QImage sobelResp;           // для thresholdResponse
+    QImage mask;                // для morphology/labelComponents: маска Отсу, 1 бит на пиксель
+    QImage linesMask;           // для houghLines: маска linesKernels, 1 бит на пиксель
+};
+
+struct Case {
+    QString op;
+    QJsonObject params;
+    std::function<QImage(const Input&)> run;   // результат держится до конца замера
+    // Если задано — результат run обязан совпасть с ним бит в бит (конвейер против вызовов)
+    std::function<QImage(const Input&)> reference;
+};
+
+std::vector<Case> makeCases(const QList<int>& windows, const QList<int>& thresholds)
+{
+    std::vector<Case> cases;
+    auto add = [&](const QString& op, QJsonObject params, std::function<QImage(const Input&)> run,
+                   std::function<QImage(const Input&)> reference = {}) {
+        cases.push_back({ op, std::move(params), std::move(run), std::move(reference) });
+    };
+
+    add("toGrayscale", {}, [](const Input& in) { return Img::toGrayscale(in.rgb); });
+    add("ImageStats::compute", {}, [](const Input& in) {
+        volatile qint64 t = Img::ImageStats::compute(in.gray).total;
+        Q_UNUSED(t);
+        return QImage();
+    });
+    add("thresholdOtsu", {}, [](const Input& in) { return Img::thresholdOtsu(in.gray); });
+    add("thresholdOtsu", {{ "cachedStats", true }}, [](const Input& in) { return Img::thresholdOtsu(in.gray, in.stats); });
+    add("thresholdIterative", {}, [](const Input& in) { return Img::thresholdIterative(in.gray); });
+    add("thresholdIterative", {{ "cachedStats", true }}, [](const Input& in) { return Img::thresholdIterative(in.gray, in.stats); });
+    add("thresholdMean", {}, [](const Input& in) { return Img::thresholdMean(in.gray); });
+    add("thresholdMean", {{ "cachedStats", true }}, [](const Input& in) { return Img::thresholdMean(in.gray, in.stats); });
+    add("thresholdOtsu", {{ "cachedStats", true }, { "mask", "mono" }},
+        [](const Input& in) { return Img::thresholdOtsu(in.gray, in.stats, Img::MaskFormat::Mono); });
+
+    for (int win : windows)
+        add("adaptiveAlpha", {{ "window", win }, { "alpha", 0.67 }},
+            [win](const Input& in) { return Img::adaptiveAlpha(in.gray, win, 0.67); });
+
+    const std::pair<const char*, Img::LocalMethod> localMethods[] = {
+        { "niblack", Img::LocalMethod::Niblack }, { "sauvola", Img::LocalMethod::Sauvola },
+        { "wolf", Img::LocalMethod::Wolf }, { "bradley", Img::LocalMethod::Bradley },
+    };
+    for (const auto& lm : localMethods) {
+        const Img::LocalMethod method = lm.second;
+        const double k = Img::localDefaultK(method);
+        for (int win : windows)
+            add("thresholdLocal", {{ "method", lm.first }, { "window", win }, { "k", k }},
+                [=](const Input& in) { return Img::thresholdLocal(in.gray, method, win, k); });
+    }
+
+    for (int t : thresholds) {
+        add("edgesSobel", {{ "threshold", t }}, [t](const Input& in) { return Img::edgesSobel(in.gray, t); });
+        add("linesKernels", {{ "threshold", t }}, [t](const Input& in) { return Img::linesKernels(in.gray, t); });
+        add("pointsLaplacian", {{ "threshold", t }}, [t](const Input& in) { return Img::pointsLaplacian(in.gray, t); });
+        add("edgesSobel", {{ "threshold", t }, { "mask", "mono" }},
+            [t](const Input& in) { return Img::edgesSobel(in.gray, t, Img::MaskFormat::Mono); });
+        add("edgesCanny", {{ "low", t / 2 }, { "high", t }},
+            [t](const Input& in) { return Img::edgesCanny(in.gray, t / 2, t); });
+    }
+
+    add("detectFused", {{ "which", "sobel|lines|points" }}, [](const Input& in) {
+        return Img::detectFused(in.gray, Img::DetectSobel | Img::DetectLines | Img::DetectPoints).sobel;
+    });
+    add("detectFused", {{ "which", "sobel|lines|points|direction" }}, [](const Input& in) {
+        return Img::detectFused(in.gray, Img::DetectSobel | Img::DetectLines | Img::DetectPoints | Img::DetectDirection).sobel;
+    });
+
+    for (double sigma : { 1.0, 4.0, 16.0 })
+        add("gaussianBlur", {{ "sigma", sigma }}, [sigma](const Input& in) { return Img::gaussianBlur(in.gray, sigma); });
+    for (int radius : { 1, 5, 25 })
+        add("medianFilter", {{ "radius", radius }}, [radius](const Input& in) { return Img::medianFilter(in.gray, radius); });
+
+    add("sobelMagnitude", {}, [](const Input& in) { return Img::sobelMagnitude(in.gray); });
+    add("linesResponse", {}, [](const Input& in) { return Img::linesResponse(in.gray); });
+    add("laplacianResponse", {}, [](const Input& in) { return Img::laplacianResponse(in.gray); });
+    for (int t : thresholds)
+        add("thresholdResponse", {{ "response", "sobel" }, { "threshold", t }},
+            [t](const Input& in) { return Img::thresholdResponse(in.sobelResp, t); });
+    add("packMask", {}, [](const Input& in) { return Img::packMask(in.gray); });
+    for (int size : { 3, 15, 101 })
+        add("morphology", {{ "op", "open" }, { "size", size }, { "mask", "mono" }},
+            [size](const Input& in) { return Img::morphology(in.mask, Img::MorphOp::Open, size, size); });
+    // Результат — статистика, а не изображение; замер держит только её
+    add("labelComponents", {{ "mask", "otsu" }}, [](const Input& in) {
+        const Img::Components comps = Img::labelComponents(in.mask, false);
+        return comps.list.empty() ? QImage() : in.mask;
+    });
+    // Узкий сектор — по умолчанию, 22.5° — все углы; плотная маска шума уходит в выборку
+    for (double sector : { 10.0, 22.5 })
+        add("houghLines", {{ "mask", "lines" }, { "sector", sector }}, [sector](const Input& in) {
+            Img::HoughParams params;
+            params.sector = sector;
+            return Img::houghLines(in.linesMask, params).empty() ? QImage() : in.linesMask;
+        });
+
+    // Цепочки вызовами по очереди и конвейером плитками; конвейер сверяется с вызовами.
+    // Со сглаживанием конвейер делится на отрезки (gaussianBlur — этап whole)
+    auto calls = [](const Input& in) {
+        return Img::morphology(Img::edgesSobel(Img::medianFilter(in.gray, 1), 90), Img::MorphOp::Open, 3, 3);
+    };
+    auto smoothedCalls = [](const Input& in) {
+        return Img::morphology(Img::edgesSobel(Img::gaussianBlur(Img::medianFilter(in.gray, 1), 2.0), 60),
+                               Img::MorphOp::Open, 3, 3);
+    };
+    add("chain", {{ "run", "calls" }}, calls);
+    add("chain", {{ "run", "pipeline" }}, [](const Input& in) {
+        return Img::Pipeline().median(1).response(Img::DetectSobel).threshold(90)
+            .morphology(Img::MorphOp::Open, 3, 3).run(in.gray);
+    }, calls);
+    add("chain", {{ "run", "calls" }, { "sigma", 2.0 }}, smoothedCalls);
+    add("chain", {{ "run", "pipeline" }, { "sigma", 2.0 }}, [](const Input& in) {
+        return Img::Pipeline().median(1).gaussian(2.0).response(Img::DetectSobel).threshold(60)
+            .morphology(Img::MorphOp::Open, 3, 3).run(in.gray);
+    }, smoothedCalls);
+
+    return cases;
+}
+
+QList<int> parseIntList(const QString& s)
+{
+    QList<int> out;
+    for (const QString& part : s.split(',', Qt::SkipEmptyParts)) out << part.trimmed().toInt();
+    return out;
+}
+
+QList<double> parseDoubleList(const QString& s)
+{
+    QList<double> out;
+    for (const QString& part : s.split(',', Qt::SkipEmptyParts)) out << part.trimmed().toDouble();
+    return out;
+}
+
+// Ключ для сопоставления результатов двух прогонов
+QString resultKey(const QJsonObject& r)
+{
+    return r["op"].toString() + "|" +
+           QString::fromUtf8(QJsonDocument(r["params"].toObject()).toJson(QJsonDocument::Compact)) + "|" +
+           r["content"].toString() + "|" +
+           QString::number(r["width"].toInt()) + "x" + QString::number(r["height"].toInt());
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("imgbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Замеры производительности операций Img");
+    parser.addHelpOption();
+    const QCommandLineOption sizesOpt("sizes", "Размеры в мегапикселях через запятую.", "mp", "1,4,16,100");
+    const QCommandLineOption contentOpt("content", "Содержимое: noise,gradient,text.", "list", "noise,gradient,text");
+    const QCommandLineOption windowsOpt("windows", "Окна adaptiveAlpha и thresholdLocal.", "list", "3,15,51,151,501");
+    const QCommandLineOption thOpt("thresholds", "Пороги детекторов.", "list", "50,100,200");
+    const QCommandLineOption repsOpt("reps", "Повторов на случай.", "n", "3");
+    const QCommandLineOption filterOpt("filter", "Только операции, содержащие подстроку.", "text");
+    const QCommandLineOption threadsOpt("threads", "Потоков Img (0 — по числу ядер).", "n", "0");
+    const QCommandLineOption jsonOpt("json", "Записать результаты в JSON (- для stdout).", "file");
+    const QCommandLineOption cmpOpt("compare", "Сравнить с результатами прошлого прогона.", "file");
+    const QCommandLineOption tolOpt("tolerance", "Допустимое замедление при сравнении, %.", "pct", "10");
+    parser.addOptions({ sizesOpt, contentOpt, windowsOpt, thOpt, repsOpt, filterOpt,
+                        threadsOpt, jsonOpt, cmpOpt, tolOpt });
+    parser.process(app);
+
+    const bool jsonToStdout = parser.value(jsonOpt) == "-";
+    QTextStream out(jsonToStdout ? stderr : stdout);
+    QTextStream err(stderr);
+
+    Img::setThreadCount(parser.value(threadsOpt).toInt());
+    const int reps = std::max(1, parser.value(repsOpt).toInt());
+    const QString filter = parser.value(filterOpt);
+
+    QList<Bench::Content> contents;
+    for (const QString& c : parser.value(contentOpt).split(',', Qt::SkipEmptyParts)) {
+        if (c == "noise")         contents << Bench::Content::Noise;
+        else if (c == "gradient") contents << Bench::Content::Gradient;
+        else if (c == "text")     contents << Bench::Content::Text;
+        else { err << "Неизвестное содержимое: " << c << "\n"; return 2; }
+    }
+
+    std::vector<Case> cases = makeCases(parseIntList(parser.value(windowsOpt)),
+                                        parseIntList(parser.value(thOpt)));
+    if (!filter.isEmpty())
+        cases.erase(std::remove_if(cases.begin(), cases.end(),
+                                   [&](const Case& c) { return !c.op.contains(filter, Qt::CaseInsensitive); }),
+                    cases.end());
+
+    const bool perCasePeak = resetPeakRss();
+    out << QString("%1%2%3%4%5%6%7%8\n")
+        .arg("операция", -22).arg("параметры", -34).arg("содержимое", -10).arg("Мп", 7)
+        .arg("медиана, мс", 13).arg("Мп/с", 10).arg("пик, МБ", 10).arg("+МБ", 8);
+
+    QJsonArray results;
+    int mismatches = 0;
+    for (double mp : parseDoubleList(parser.value(sizesOpt))) {
+        const QSize size = Bench::sizeForMegapixels(mp);
+        for (Bench::Content content : contents) {
+            Input in;
+            in.gray = Bench::synthetic(content, size);
+            if (in.gray.isNull()) {
+                err << "Не удалось выделить изображение " << size.width() << "x" << size.height() << "\n";
+                continue;
+            }
+            in.rgb = in.gray.convertToFormat(QImage::Format_RGB32);
+            in.stats = Img::ImageStats::compute(in.gray);
+            in.sobelResp = Img::sobelMagnitude(in.gray);
+            in.mask = Img::thresholdOtsu(in.gray, in.stats, Img::MaskFormat::Mono);
+            in.linesMask = Img::linesKernels(in.gray, 120, Img::MaskFormat::Mono);
+            const double megapixels = double(size.width()) * size.height() / 1e6;
+
+            for (const Case& c : cases) {
+                // На Linux после сброса пик равен текущему RSS (входные данные),
+                // разница с ним — память, которую заняла сама операция
+                resetPeakRss();
+                const qint64 base = peakRssBytes();
+                std::vector<double> times;
+                QImage result;
+                for (int r=0; r<reps; ++r) {
+                    result = QImage();
+                    QElapsedTimer t;
+                    t.start();
+                    result = c.run(in);
+                    times.push_back(t.nsecsElapsed() / 1e6);
+                }
+                std::sort(times.begin(), times.end());
+                const double median = times[times.size() / 2];
+                const qint64 peak = peakRssBytes();
+                // Сверка — после замера памяти: эталон в пик случая не входит
+                const bool matches = !c.reference || result == c.reference(in);
+                result = QImage();
+
+                QJsonObject r;
+                r["op"] = c.op;
+                r["params"] = c.params;
+                r["content"] = Bench::contentName(content);
+                r["width"] = size.width();
+                r["height"] = size.height();
+                r["megapixels"] = megapixels;
+                r["reps"] = reps;
+                r["minMs"] = times.front();
+                r["medianMs"] = median;
+                r["mpPerSec"] = median > 0 ? megapixels / (median / 1000.0) : 0.0;
+                r["peakRssBytes"] = double(peak);
+                r["baseRssBytes"] = double(base);
+                if (c.reference) r["matchesReference"] = matches;
+                results.append(r);
+
+                const QString params = QString::fromUtf8(QJsonDocument(c.params).toJson(QJsonDocument::Compact));
+                out << QString("%1%2%3%4%5%6%7%8\n")
+                    .arg(c.op, -22).arg(c.params.isEmpty() ? QString() : params, -34)
+                    .arg(Bench::contentName(content), -10).arg(megapixels, 7, 'f', 1)
+                    .arg(median, 13, 'f', 2).arg(r["mpPerSec"].toDouble(), 10, 'f', 1)
+                    .arg(peak / 1048576.0, 10, 'f', 0)
+                    .arg(std::max<qint64>(0, peak - base) / 1048576.0, 8, 'f', 0);
+                if (!matches) {
+                    ++mismatches;
+                    out << "  РАСХОЖДЕНИЕ: результат " << c.op << " не совпадает с вызовами по очереди\n";
+                }
+                out.flush();
+            }
+        }
+    }
+
+    QJsonObject doc;
+    doc["version"] = 1;
+    doc["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    doc["qt"] = QString(qVersion());
+    doc["cpu"] = QSysInfo::currentCpuArchitecture();
+    doc["os"] = QSysInfo::prettyProductName();
+    doc["simd"] = QString(Img::Simd::kernels3x3().name);
+    doc["threads"] = Img::threadCount();
+    doc["perCasePeakMemory"] = perCasePeak;
+    doc["results"] = results;
+
+    if (parser.isSet(jsonOpt)) {
+        const QByteArray json = QJsonDocument(doc).toJson(QJsonDocument::Indented);
+        if (jsonToStdout) {
+            QTextStream(stdout) << json;
+        } else {
+            QFile f(parser.value(jsonOpt));
+            if (!f.open(QFile::WriteOnly) || f.write(json) != json.size()) {
+                err << "Не удалось записать " << parser.value(jsonOpt) << "\n";
+                return 2;
+            }
+        }
+    }
+
+    // Сравнение с прошлым прогоном: только совпадающие случаи
+    if (parser.isSet(cmpOpt)) {
+        QFile f(parser.value(cmpOpt));
+        if (!f.open(QFile::ReadOnly)) {
+            err << "Не удалось открыть " << parser.value(cmpOpt) << "\n";
+            return 2;
+        }
+        QHash<QString, double> baseline;
+        for (const QJsonValue& v : QJsonDocument::fromJson(f.readAll()).object()["results"].toArray())
+            baseline.insert(resultKey(v.toObject()), v.toObject()["medianMs"].toDouble());
+
+        const double tolerance = parser.value(tolOpt).toDouble();
+        int compared = 0, regressions = 0;
+        out << "\nСравнение с " << parser.value(cmpOpt) << " (допуск " << tolerance << "%):\n";
+        for (const QJsonValue& v : results) {
+            const QJsonObject r = v.toObject();
+            const auto it = baseline.constFind(resultKey(r));
+            if (it == baseline.constEnd() || *it <= 0) continue;
+            ++compared;
+            const double change = (r["medianMs"].toDouble() / *it - 1.0) * 100.0;
+            if (change > tolerance) {
+                ++regressions;
+                out << "  РЕГРЕССИЯ " << resultKey(r) << ": " << QString::number(*it, 'f', 2) << " → "
+                    << QString::number(r["medianMs"].toDouble(), 'f', 2) << " мс (+"
+                    << QString::number(change, 'f', 1) << "%)\n";
+            }
+        }
+        out << "Сравнено случаев: " << compared << ", регрессий: " << regressions << "\n";
+        if (regressions > 0) return 1;
+    }
+    return mismatches > 0 ? 1 : 0;
+}
@@ -0,0 +1,118 @@
+#include "synthetic.h"
+
+#include <QtMath>
+#include <algorithm>
+
+namespace {
+
+// xorshift32: быстрее std::mt19937 на сотне мегапикселей, качества для шума хватает
+struct Rng {
+    quint32 s;
+    explicit Rng(quint32 seed) : s(seed ? seed : 0x9E3779B9u) {}
+    quint32 next() { s ^= s << 13; s ^= s >> 17; s ^= s << 5; return s; }
+    int uniform(int lo, int hi) { return lo + int(next() % quint32(hi - lo + 1)); }
+};
+
+void fillNoise(QImage& img, quint32 seed)
+{
+    for (int y=0; y<img.height(); ++y) {
+        Rng rng(seed * 2654435761u + quint32(y) + 1);
+        uchar* d = img.scanLine(y);
+        for (int x=0; x<img.width(); ++x) d[x] = uchar(rng.next() >> 24);
+    }
+}
+
+void fillGradient(QImage& img)
+{
+    const int w = img.width(), h = img.height();
+    const double cx = w * 0.6, cy = h * 0.4, r = std::max(1.0, std::hypot(double(w), double(h)) / 2);
+    for (int y=0; y<h; ++y) {
+        uchar* d = img.scanLine(y);
+        for (int x=0; x<w; ++x) {
+            // линейный наклон + радиальное пятно
+            const double lin = 255.0 * (x + y) / std::max(1, w + h - 2);
+            const double rad = 255.0 * (1.0 - std::min(1.0, std::hypot(x - cx, y - cy) / r));
+            d[x] = uchar(qBound(0, int(0.5 * lin + 0.5 * rad), 255));
+        }
+    }
+}
+
+// Страница текста: светлый фон с виньеткой и строки «слов» из тёмных штрихов
+void fillText(QImage& img, quint32 seed)
+{
+    const int w = img.width(), h = img.height();
+    Rng rng(seed);
+
+    for (int y=0; y<h; ++y) {
+        uchar* d = img.scanLine(y);
+        const double vy = double(y) / std::max(1, h - 1) - 0.5;
+        for (int x=0; x<w; ++x) {
+            const double vx = double(x) / std::max(1, w - 1) - 0.5;
+            d[x] = uchar(225 - int(90.0 * (vx*vx + vy*vy)) - int((x ^ y) & 7));
+        }
+    }
+
+    const int lineStep = 24, glyphH = 14, margin = 16;
+    for (int top = margin; top + glyphH < h - margin; top += lineStep) {
+        int x = margin;
+        while (x < w - margin) {
+            const int word = rng.uniform(2, 9);   // букв в слове
+            for (int g=0; g<word && x + 10 < w - margin; ++g) {
+                const int gw = rng.uniform(6, 10);
+                const uchar ink = uchar(rng.uniform(20, 70));
+                // 1–2 вертикальных и 1 горизонтальный штрих на «букву»
+                const int strokes = rng.uniform(1, 2);
+                for (int s=0; s<strokes; ++s) {
+                    const int sx = x + rng.uniform(0, gw - 2);
+                    for (int yy=top; yy<top+glyphH; ++yy) {
+                        uchar* d = img.scanLine(yy);
+                        d[sx] = ink; d[sx+1] = ink;
+                    }
+                }
+                const int sy = top + rng.uniform(0, 2) * (glyphH - 2) / 2;
+                for (int yy=sy; yy<sy+2; ++yy) {
+                    uchar* d = img.scanLine(yy);
+                    std::fill(d + x, d + x + gw, ink);
+                }
+                x += gw + 2;
+            }
+            x += rng.uniform(8, 16);   // пробел
+        }
+    }
+}
+
+} // namespace
+
+namespace Bench {
+
+QString contentName(Content c)
+{
+    switch (c) {
+    case Content::Noise:    return "noise";
+    case Content::Gradient: return "gradient";
+    case Content::Text:     return "text";
+    }
+    return QString();
+}
+
+QSize sizeForMegapixels(double megapixels)
+{
+    const double pixels = megapixels * 1e6;
+    const int h = std::max(1, int(std::sqrt(pixels * 3.0 / 4.0)));
+    const int w = std::max(1, int(pixels / h));
+    return QSize(w, h);
+}
+
+QImage synthetic(Content c, QSize size, quint32 seed)
+{
+    QImage img(size, QImage::Format_Grayscale8);
+    if (img.isNull()) return img;
+    switch (c) {
+    case Content::Noise:    fillNoise(img, seed); break;
+    case Content::Gradient: fillGradient(img); break;
+    case Content::Text:     fillText(img, seed); break;
+    }
+    return img;
+}
+
+} // namespace Bench
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+// Синтетические серые изображения для замеров: содержимое детерминировано
+// (зависит только от размера и seed), поэтому результаты разных версий сравнимы.
+namespace Bench {
+
+enum class Content {
+    Noise,      // равномерный шум — худший случай для ветвлений и сжатия
+    Gradient,   // плавные градиенты — длинные однородные участки
+    Text,       // «страница»: строки штрихов на неравномерно освещённом фоне
+};
+
+QString contentName(Content c);
+
+// Размер с соотношением сторон 4:3 и площадью около megapixels·10^6 пикселей
+QSize sizeForMegapixels(double megapixels);
+
+QImage synthetic(Content c, QSize size, quint32 seed = 1);
+
+} // namespace Bench
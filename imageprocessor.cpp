@@ -1,8 +1,21 @@
-#include "ImageProcessor.h"
+#include "imageprocessor.h"
+#include "simdkernels.h"
+#include "parallel.h"
+#include "stencil.h"
+#include "integral.h"
 #include <QtMath>
+#include <QtEndian>
+#include <QtAlgorithms>
+#include <array>
 #include <vector>
+#include <memory>
 #include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <unordered_map>
 
 namespace {
 
@@ -10,6 +23,57 @@ namespace {
 inline const uchar* rowPtr(const QImage& im, int y) { return im.constScanLine(y); }
 inline uchar*       rowPtr(QImage& im, int y)       { return im.scanLine(y); }
 
+// Базовый указатель и шаг строк результата. Берутся один раз до параллельного
+// прохода: scanLine() из нескольких потоков на одном QImage лучше не вызывать.
+struct RowWriter {
+    uchar* base;
+    qsizetype bpl;
+    explicit RowWriter(QImage& im) : base(im.bits()), bpl(im.bytesPerLine()) {}
+    uchar* operator()(int y) const { return base + bpl * y; }
+};
+
+// ---------------- Двоичные маски ----------------
+
+// Пустая маска: Grayscale8 или MonoLSB с таблицей {чёрный, белый}
+QImage makeMask(int w, int h, Img::MaskFormat format)
+{
+    if (format == Img::MaskFormat::Gray8) return QImage(w, h, QImage::Format_Grayscale8);
+    QImage out(w, h, QImage::Format_MonoLSB);
+    out.setColorCount(2);
+    out.setColor(0, qRgb(0, 0, 0));
+    out.setColor(1, qRgb(255, 255, 255));
+    return out;
+}
+
+inline bool isPacked(const QImage& im) { return im.format() == QImage::Format_MonoLSB; }
+
+// Упаковка строки маски в биты MonoLSB по 8 пикселей за шаг: старшие биты восьми
+// байт (яркость >= 128) одним умножением собираются в старший байт слова,
+// бит i — из байта i. Строка маски живёт в буфере полосы и не покидает L1.
+inline void packRow(const uchar* src, uchar* dst, int w)
+{
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        const quint64 v = qFromLittleEndian<quint64>(src + x) & 0x8080808080808080ull;
+        dst[x >> 3] = uchar((v * 0x0002040810204081ull) >> 56);
+    }
+    if (x < w) {
+        uchar b = 0;
+        for (int i = 0; x + i < w; ++i)
+            if (src[x + i] & 0x80) b |= uchar(1u << i);
+        dst[x >> 3] = b;
+    }
+}
+
+// Обратно: биты MonoLSB -> 255/0 в buf; возвращает buf.data()
+inline const uchar* unpackRow(const uchar* bits, int w, std::vector<uchar>& buf)
+{
+    buf.resize(size_t(w));
+    for (int x = 0; x < w; ++x)
+        buf[x] = ((bits[x >> 3] >> (x & 7)) & 1) ? 255 : 0;
+    return buf.data();
+}
+
 // Отражение индекса для граничных условий (reflect)
 inline int refl(int i, int n) {
     if (i < 0)   return -i - 1;
@@ -17,46 +81,286 @@ inline int refl(int i, int n) {
     return i;
 }
 
-// Получить значение пикселя с отражением
-inline int getPixReflect(const QImage& g, int x, int y) {
-    const int xx = refl(x, g.width());
-    const int yy = refl(y, g.height());
-    return rowPtr(g, yy)[xx];
+// Окрестность 3x3 в точке по трём строкам и индексам столбцов xl/xc/xr.
+// Индексы уже отражены вызывающим кодом, поэтому здесь нет ни одной проверки границ.
+inline Img::Stencil::Window<int> window3(const uchar* r0, const uchar* r1, const uchar* r2,
+                                         int xl, int xc, int xr)
+{
+    return {{ { r0[xl], r0[xc], r0[xr] },
+              { r1[xl], r1[xc], r1[xr] },
+              { r2[xl], r2[xc], r2[xr] } }};
 }
 
-// Единственная «атомарная» signed-свёртка в точке (x,y)
-template<typename T>
-int convAtSigned(const QImage& g, const std::vector<T>& k, int kw, int kh, int x, int y)
+// Движок свёртки 3x3 с отражающими границами.
+// Строки y-1/y+1 отражаются один раз на строку (указатели на соседние scanline),
+// граничные столбцы 0 и w-1 считаются отдельно через refl(), а внутренний цикл
+// x = 1..w-2 идёт по сырым указателям без ветвлений.
+// op(r0, r1, r2, xl, xc, xr) возвращает значение выходного пикселя типа T
+// (uchar для масок, quint16 для карт откликов).
+// fast(r0, r1, r2, d, x0, x1) — векторная реализация из simdkernels: обрабатывает
+// основную часть внутреннего участка строки и возвращает первый необработанный
+// столбец, хвост досчитывает op.
+template<typename T, typename PixelOp, typename FastRow>
+void sweep3x3(const QImage& g, QImage& out, PixelOp op, FastRow fast)
 {
-    const int cx = kw/2;
-    const int cy = kh/2;
-    long long acc = 0;
-    for (int j=0; j<kh; ++j) {
-        for (int i=0; i<kw; ++i) {
-            const int px = getPixReflect(g, x + i - cx, y + j - cy);
-            acc += 1LL * px * k[j*kw + i];
+    const int w = g.width(), h = g.height();
+    if (w == 0) return;
+    const RowWriter dst(out);
+    // Упакованная маска: строка считается в буфер полосы и сразу упаковывается
+    const bool packed = isPacked(out);
+    Img::Parallel::forRange(0, h, Img::Parallel::rowsPerBand(w), [&](int yb, int ye) {
+        std::vector<T> scratch(packed ? w : 0);
+        for (int y=yb; y<ye; ++y) {
+            const uchar* r0 = rowPtr(g, refl(y-1, h));
+            const uchar* r1 = rowPtr(g, y);
+            const uchar* r2 = rowPtr(g, refl(y+1, h));
+            T* d = packed ? scratch.data() : reinterpret_cast<T*>(dst(y));
+
+            d[0] = op(r0, r1, r2, refl(-1, w), 0, refl(1, w));
+            int x = fast(r0, r1, r2, d, 1, w-1);
+            for (; x<w-1; ++x)
+                d[x] = op(r0, r1, r2, x-1, x, x+1);
+            if (w > 1)
+                d[w-1] = op(r0, r1, r2, w-2, w-1, refl(w, w));
+            if constexpr (std::is_same<T, uchar>::value)
+                if (packed) packRow(d, dst(y), w);
         }
+    });
+}
+
+// Векторная строка маски с фиксированным порогом — в форме, которую ждёт sweep3x3
+struct FastMask {
+    Img::Simd::Row3Fn fn;
+    int threshold;
+    int operator()(const uchar* r0, const uchar* r1, const uchar* r2, uchar* d, int x0, int x1) const {
+        return fn(r0, r1, r2, d, x0, x1, threshold);
     }
-    return static_cast<int>(acc);
+};
+
+// ---------------- Отклики детекторов в точке ----------------
+
+// Ядра описаны в stencil.h и разворачиваются на этапе компиляции
+// (Собель — сепарабельно, линии — через общую сумму окрестности).
+
+// Модуль градиента Собеля (усечённый до целого)
+inline int sobelMagAt(const uchar* r0, const uchar* r1, const uchar* r2, int xl, int xc, int xr)
+{
+    int gx, gy;
+    Img::Stencil::sobel(gx, gy, window3(r0, r1, r2, xl, xc, xr));
+    return int(std::hypot(double(gx), double(gy)));
 }
 
-// Интегральное изображение (для быстрого локального среднего)
-void integralImageU8(const QImage& g, std::vector<uint32_t>& ii)
+// Максимум модулей откликов четырёх направленных ядер
+inline int linesRespAt(const uchar* r0, const uchar* r1, const uchar* r2, int xl, int xc, int xr)
 {
-    const int w = g.width(), h = g.height();
-    ii.assign((w+1)*(h+1), 0);
-    for (int y=1; y<=h; ++y) {
-        uint32_t rowSum = 0;
-        const uchar* p = rowPtr(g, y-1);
-        for (int x=1; x<=w; ++x) {
-            rowSum += p[x-1];
-            ii[y*(w+1)+x] = ii[(y-1)*(w+1)+x] + rowSum;
+    int r[4];
+    Img::Stencil::lines(r, window3(r0, r1, r2, xl, xc, xr));
+    return std::max({ std::abs(r[0]), std::abs(r[1]), std::abs(r[2]), std::abs(r[3]) });
+}
+
+// Модуль Лапласиана
+inline int laplacianRespAt(const uchar* r0, const uchar* r1, const uchar* r2, int xl, int xc, int xr)
+{
+    int lap;
+    Img::Stencil::laplacian(lap, window3(r0, r1, r2, xl, xc, xr));
+    return std::abs(lap);
+}
+
+// atan2(gy, gx) в единицах 1/256 оборота.
+// Полиномиальное приближение арктангенса на [0, π/4] (ошибка < 0.004 рад,
+// т.е. меньше 0.16 кода) и разворот по октантам — без ветвлений и вызовов libm,
+// так что цикл по строке векторизуется компилятором.
+inline uchar directionCode(int gx, int gy)
+{
+    const float ax = float(std::abs(gx)), ay = float(std::abs(gy));
+    const float mx = std::max(ax, ay), mn = std::min(ax, ay);
+    const float z = (mx > 0.0f) ? mn / mx : 0.0f;
+    float a = z * (0.78539816f + 0.273f * (1.0f - z));   // atan(z), z ∈ [0, 1]
+    a = (ay > ax) ? 1.57079633f - a : a;
+    a = (gx < 0)  ? 3.14159265f - a : a;
+    a = (gy < 0)  ? -a : a;
+    // округление к ближайшему через усечение положительного числа
+    return uchar((int(a * (128.0f / 3.14159265f) + 256.5f) - 256) & 255);
+}
+
+// Направление градиента Собеля в точке
+inline uchar directionAt(const uchar* r0, const uchar* r1, const uchar* r2, int xl, int xc, int xr)
+{
+    int gx, gy;
+    Img::Stencil::sobel(gx, gy, window3(r0, r1, r2, xl, xc, xr));
+    return directionCode(gx, gy);
+}
+
+// Глобальная бинаризация: 255 там, где яркость строго больше порога T
+QImage binarizeAbove(const QImage& gray, double T, Img::MaskFormat format)
+{
+    const int w = gray.width(), h = gray.height();
+    QImage out = makeMask(w, h, format);
+    const RowWriter dst(out);
+    const bool packed = isPacked(out);
+    Img::Parallel::forRange(0, h, Img::Parallel::rowsPerBand(w), [&](int yb, int ye) {
+        std::vector<uchar> scratch(packed ? w : 0);
+        for (int y=yb; y<ye; ++y) {
+            const uchar* s = rowPtr(gray, y);
+            uchar* d = packed ? scratch.data() : dst(y);
+            for (int x=0; x<w; ++x) d[x] = (s[x] > T) ? 255 : 0;
+            if (packed) packRow(d, dst(y), w);
+        }
+    });
+    return out;
+}
+
+// Решение α-метода для пикселя f по локальным mean/fmin/fmax
+inline uchar alphaPixel(int f, double mean, int fmin, int fmax, double alpha)
+{
+    const double dFmax = std::abs(fmax - mean);
+    const double dFmin = std::abs(fmin - mean);
+
+    // 3) выбор порога t по лекционной логике
+    double t = 0.0;
+    if (fmax == fmin) {
+        t = alpha * mean;
+    } else if (std::abs(dFmax - dFmin) < 1e-9) {
+        // равновесие — берём α*mean
+        t = alpha * mean;
+    } else if (dFmax > dFmin) {
+        t = alpha * ( (2.0/3.0)*fmin + (1.0/3.0)*mean );
+    } else {
+        t = alpha * ( (1.0/3.0)*fmin + (2.0/3.0)*mean );
+    }
+
+    // 4) сравнение |f - Ĥ| > t, где Ĥ ≡ mean
+    const double Hxy = mean;
+    return (std::abs(f - Hxy) > t) ? 255 : 0;
+}
+
+// ---------------- Скользящие min/max (van Herk / Gil-Werman) ----------------
+//
+// Окно длины N = 2K+1 обрезается по краям (как в adaptiveAlpha): снаружи
+// последовательность дополняется нейтральными значениями (255 для min, 0 для max).
+// Дополненная последовательность бьётся на блоки по N; внутри блока считаются
+// префиксные (g) и суффиксные (h) экстремумы, и окно [i, i+N-1] = min(h[i], g[i+N-1]).
+// На элемент приходится три сравнения независимо от N.
+
+// Длина дополненной последовательности, кратная N
+inline int vanHerkLength(int n, int K)
+{
+    const int N = 2*K + 1;
+    return ((n + 2*K + N - 1) / N) * N;
+}
+
+// Одномерный проход по строке src[0..n): результат в outMin/outMax
+void slidingMinMaxRow(const uchar* src, int n, int K, uchar* outMin, uchar* outMax,
+                      std::vector<uchar>& gMin, std::vector<uchar>& gMax,
+                      std::vector<uchar>& hMin, std::vector<uchar>& hMax)
+{
+    const int N = 2*K + 1;
+    const int L = vanHerkLength(n, K);
+    gMin.resize(L); gMax.resize(L); hMin.resize(L); hMax.resize(L);
+
+    for (int i=0; i<L; ++i) {
+        const bool in = (i >= K) && (i < K + n);
+        const uchar vmin = in ? src[i-K] : 255;
+        const uchar vmax = in ? src[i-K] : 0;
+        if (i % N == 0) { gMin[i] = vmin; gMax[i] = vmax; }
+        else            { gMin[i] = std::min(gMin[i-1], vmin); gMax[i] = std::max(gMax[i-1], vmax); }
+    }
+    for (int i=L-1; i>=0; --i) {
+        const bool in = (i >= K) && (i < K + n);
+        const uchar vmin = in ? src[i-K] : 255;
+        const uchar vmax = in ? src[i-K] : 0;
+        if (i % N == N-1) { hMin[i] = vmin; hMax[i] = vmax; }
+        else              { hMin[i] = std::min(hMin[i+1], vmin); hMax[i] = std::max(hMax[i+1], vmax); }
+    }
+    for (int x=0; x<n; ++x) {
+        outMin[x] = std::min(hMin[x], gMin[x+N-1]);
+        outMax[x] = std::max(hMax[x], gMax[x+N-1]);
+    }
+}
+
+// Вертикальный проход по полосе столбцов [c0, c1) карт mn/mx (w x h), на месте.
+// Та же схема van Herk, но «элемент» — отрезок строки, поэтому внутренние циклы
+// идут по соседним байтам и хорошо векторизуются компилятором.
+void slidingMinMaxColumns(uchar* mn, uchar* mx, int w, int h, int K, int c0, int c1,
+                          std::vector<uchar>& gMin, std::vector<uchar>& gMax,
+                          std::vector<uchar>& hMin, std::vector<uchar>& hMax)
+{
+    const int N = 2*K + 1;
+    const int L = vanHerkLength(h, K);
+    const int S = c1 - c0;
+    gMin.resize(size_t(L)*S); gMax.resize(size_t(L)*S);
+    hMin.resize(size_t(L)*S); hMax.resize(size_t(L)*S);
+
+    auto srcRow = [&](const uchar* m, int i) -> const uchar* {
+        const int y = i - K;
+        return (y >= 0 && y < h) ? m + size_t(y)*w + c0 : nullptr;
+    };
+
+    for (int i=0; i<L; ++i) {
+        const uchar* pn = srcRow(mn, i);
+        const uchar* px = srcRow(mx, i);
+        uchar* gn = &gMin[size_t(i)*S];
+        uchar* gx = &gMax[size_t(i)*S];
+        if (i % N == 0) {
+            for (int c=0; c<S; ++c) { gn[c] = pn ? pn[c] : 255; gx[c] = px ? px[c] : 0; }
+        } else {
+            const uchar* pgn = gn - S;
+            const uchar* pgx = gx - S;
+            if (pn) for (int c=0; c<S; ++c) { gn[c] = std::min(pgn[c], pn[c]); gx[c] = std::max(pgx[c], px[c]); }
+            else    for (int c=0; c<S; ++c) { gn[c] = pgn[c]; gx[c] = pgx[c]; }
+        }
+    }
+    for (int i=L-1; i>=0; --i) {
+        const uchar* pn = srcRow(mn, i);
+        const uchar* px = srcRow(mx, i);
+        uchar* hn = &hMin[size_t(i)*S];
+        uchar* hx = &hMax[size_t(i)*S];
+        if (i % N == N-1) {
+            for (int c=0; c<S; ++c) { hn[c] = pn ? pn[c] : 255; hx[c] = px ? px[c] : 0; }
+        } else {
+            const uchar* nhn = hn + S;
+            const uchar* nhx = hx + S;
+            if (pn) for (int c=0; c<S; ++c) { hn[c] = std::min(nhn[c], pn[c]); hx[c] = std::max(nhx[c], px[c]); }
+            else    for (int c=0; c<S; ++c) { hn[c] = nhn[c]; hx[c] = nhx[c]; }
         }
     }
+    for (int y=0; y<h; ++y) {
+        const uchar* hn = &hMin[size_t(y)*S];
+        const uchar* hx = &hMax[size_t(y)*S];
+        const uchar* gn = &gMin[size_t(y+N-1)*S];
+        const uchar* gx = &gMax[size_t(y+N-1)*S];
+        uchar* on = mn + size_t(y)*w + c0;
+        uchar* ox = mx + size_t(y)*w + c0;
+        for (int c=0; c<S; ++c) { on[c] = std::min(hn[c], gn[c]); ox[c] = std::max(hx[c], gx[c]); }
+    }
 }
-inline uint32_t rectSum(const std::vector<uint32_t>& ii, int w, int x0,int y0,int x1,int y1) {
-    // прямоугольник [x0,x1) x [y0,y1)
-    return ii[y1*(w+1)+x1] - ii[y0*(w+1)+x1] - ii[y1*(w+1)+x0] + ii[y0*(w+1)+x0];
+
+// Карты локальных минимумов и максимумов по окну (2K+1)x(2K+1), обрезанному по границам.
+// Сепарабельно: сначала строки, затем столбцы полосами фиксированной ширины.
+void localMinMax(const QImage& g, int K, std::vector<uchar>& fmin, std::vector<uchar>& fmax)
+{
+    const int w = g.width(), h = g.height();
+    fmin.resize(size_t(w)*h);
+    fmax.resize(size_t(w)*h);
+
+    // Строки независимы — по полосам строк; у каждой полосы свои рабочие буферы
+    Img::Parallel::forRange(0, h, Img::Parallel::rowsPerBand(w), [&](int yb, int ye) {
+        std::vector<uchar> gMin, gMax, hMin, hMax;
+        for (int y=yb; y<ye; ++y)
+            slidingMinMaxRow(rowPtr(g, y), w, K, &fmin[size_t(y)*w], &fmax[size_t(y)*w],
+                             gMin, gMax, hMin, hMax);
+    });
+
+    // Столбцы независимы — по полосам столбцов (вертикальный «ореол» окна целиком внутри полосы)
+    const int strip = 512;
+    const int strips = (w + strip - 1) / strip;
+    Img::Parallel::forRange(0, strips, 1, [&](int sb, int se) {
+        std::vector<uchar> gMin, gMax, hMin, hMax;
+        for (int si=sb; si<se; ++si)
+            slidingMinMaxColumns(fmin.data(), fmax.data(), w, h, K,
+                                 si*strip, std::min(w, (si+1)*strip),
+                                 gMin, gMax, hMin, hMax);
+    });
 }
 
 } // namespace
@@ -69,21 +373,110 @@ QImage toGrayscale(const QImage& src)
     return src.convertToFormat(QImage::Format_Grayscale8);
 }
 
-// ---------------- Глобальные пороги ----------------
+QImage downsample2x(const QImage& gray)
+{
+    const int w = gray.width(), h = gray.height();
+    const int ow = (w + 1) / 2, oh = (h + 1) / 2;
+    QImage out(ow, oh, QImage::Format_Grayscale8);
+    if (w == 0 || h == 0) return out;
+    const RowWriter dst(out);
+    const bool packed = isPacked(gray);   // маска: биты разворачиваются в 255/0 по строкам
+    Parallel::forRange(0, oh, Parallel::rowsPerBand(w * 2), [&](int yb, int ye) {
+        std::vector<uchar> u0, u1;
+        for (int y=yb; y<ye; ++y) {
+            const uchar* s0 = rowPtr(gray, 2*y);
+            const uchar* s1 = rowPtr(gray, std::min(2*y + 1, h - 1));
+            if (packed) {
+                s0 = unpackRow(s0, w, u0);
+                s1 = unpackRow(s1, w, u1);
+            }
+            uchar* d = dst(y);
+            const int full = w / 2;
+            for (int x=0; x<full; ++x)
+                d[x] = uchar((s0[2*x] + s0[2*x+1] + s1[2*x] + s1[2*x+1] + 2) >> 2);
+            if (w & 1)
+                d[ow-1] = uchar((s0[w-1] + s1[w-1] + 1) >> 1);
+        }
+    });
+    return out;
+}
+
+QImage packMask(const QImage& gray)
+{
+    if (isPacked(gray)) return gray;
+    const QImage src = gray.format() == QImage::Format_Grayscale8 ? gray : toGrayscale(gray);
+    const int w = src.width(), h = src.height();
+    QImage out = makeMask(w, h, MaskFormat::Mono);
+    if (w == 0 || h == 0) return out;
+    const RowWriter dst(out);
+    Parallel::forRange(0, h, Parallel::rowsPerBand(w), [&](int yb, int ye) {
+        for (int y=yb; y<ye; ++y) packRow(rowPtr(src, y), dst(y), w);
+    });
+    return out;
+}
 
-QImage thresholdOtsu(const QImage& gray)
+// ---------------- Статистика яркости ----------------
+
+ImageStats ImageStats::compute(const QImage& gray)
 {
     const int w = gray.width();
     const int h = gray.height();
-    const int L = 256;
+    ImageStats st;
+    if (w == 0 || h == 0) return st;
+
+    // Каждая полоса набирает свою гистограмму; внутри полосы — четыре
+    // чередующиеся подгистограммы, чтобы соседние одинаковые пиксели
+    // не упирались в одну и ту же ячейку памяти.
+    using Hist = std::array<qint64, 256>;
+    st.hist = Parallel::reduce(0, h, Parallel::rowsPerBand(w), Hist{},
+        [&](int yb, int ye) {
+            std::array<std::array<quint32, 256>, 4> sub{};
+            Hist part{};
+            qint64 pending = 0;
+            for (int y = yb; y < ye; ++y) {
+                const uchar* p = rowPtr(gray, y);
+                int x = 0;
+                for (; x + 4 <= w; x += 4) {
+                    ++sub[0][p[x]]; ++sub[1][p[x+1]]; ++sub[2][p[x+2]]; ++sub[3][p[x+3]];
+                }
+                for (; x < w; ++x) ++sub[0][p[x]];
+                // сбрасываем в 64 бит, пока 32-битные счётчики не переполнились
+                pending += w;
+                if (pending > 0x7fffffff - qint64(w) || y + 1 == ye) {
+                    pending = 0;
+                    for (int i = 0; i < 256; ++i) {
+                        part[i] += qint64(sub[0][i]) + sub[1][i] + sub[2][i] + sub[3][i];
+                        sub[0][i] = sub[1][i] = sub[2][i] = sub[3][i] = 0;
+                    }
+                }
+            }
+            return part;
+        },
+        [](Hist& acc, const Hist& part) { for (int i = 0; i < 256; ++i) acc[i] += part[i]; });
 
-    int hist[L] = {0};
-    for (int y = 0; y < h; ++y) {
-        const uchar* p = rowPtr(gray, y);
-        for (int x = 0; x < w; ++x) hist[p[x]]++;
+    return fromHistogram(st.hist);
+}
+
+ImageStats ImageStats::fromHistogram(const std::array<qint64, 256>& hist)
+{
+    ImageStats st;
+    st.hist = hist;
+    qint64 count = 0, sum = 0;
+    for (int i = 0; i < 256; ++i) {
+        count += st.hist[i];
+        sum += qint64(i) * st.hist[i];
+        st.cumCount[i] = count;
+        st.cumSum[i] = sum;
     }
+    st.total = count;
+    st.mean = count ? double(sum) / double(count) : 0.0;
+    return st;
+}
 
-    const double H = double(w * h);
+int ImageStats::otsuThreshold() const
+{
+    const int L = 256;
+    const double H = double(total);
 
     double p[L];
     for (int i = 0; i < L; ++i) p[i] = hist[i] / H;
@@ -106,150 +499,1362 @@ QImage thresholdOtsu(const QImage& gray)
         const double sigmaB2 = P0*(1.0 - P0)*(mu0 - mu1)*(mu0 - mu1);
         if (sigmaB2 > maxSigmaB) { maxSigmaB = sigmaB2; bestT = t; }
     }
+    return bestT;
+}
 
-    QImage out(w, h, QImage::Format_Grayscale8);
-    for (int y=0; y<h; ++y) {
-        const uchar* s = rowPtr(gray, y);
-        uchar* d = rowPtr(out, y);
-        for (int x=0; x<w; ++x) d[x] = (s[x] > bestT) ? 255 : 0;
+double ImageStats::isodataThreshold() const
+{
+    // ISODATA целиком на гистограмме: классы «≤ T» и «> T» берутся из накопленных сумм
+    double T = mean;
+    for (int iter=0; iter<50; ++iter) {
+        const int k = std::min(255, int(std::floor(T)));   // p ≤ T  <=>  p ≤ floor(T)
+        const qint64 c1 = (k >= 0) ? cumCount[k] : 0;
+        const qint64 m1 = (k >= 0) ? cumSum[k] : 0;
+        const qint64 c2 = total - c1;
+        const qint64 m2 = cumSum[255] - m1;
+        if (c1==0 || c2==0) break;
+        const double newT = 0.5 * (double(m1)/c1 + double(m2)/c2);
+        if (qFabs(newT - T) < 0.5) { T = newT; break; }
+        T = newT;
     }
+    return T;
+}
+
+// ---------------- Глобальные пороги ----------------
+
+QImage thresholdOtsu(const QImage& gray, MaskFormat format)
+{
+    return thresholdOtsu(gray, ImageStats::compute(gray), format);
+}
+
+QImage thresholdOtsu(const QImage& gray, const ImageStats& stats, MaskFormat format)
+{
+    return binarizeAbove(gray, stats.otsuThreshold(), format);
+}
+
+QImage thresholdIterative(const QImage& gray, MaskFormat format)
+{
+    return thresholdIterative(gray, ImageStats::compute(gray), format);
+}
+
+QImage thresholdIterative(const QImage& gray, const ImageStats& stats, MaskFormat format)
+{
+    return binarizeAbove(gray, stats.isodataThreshold(), format);
+}
+
+QImage thresholdMean(const QImage& gray, MaskFormat format)
+{
+    return thresholdMean(gray, ImageStats::compute(gray), format);
+}
+
+QImage thresholdMean(const QImage& gray, const ImageStats& stats, MaskFormat format)
+{
+    return binarizeAbove(gray, stats.mean, format);
+}
+
+
+
+// ---------------- Гауссово сглаживание (Янг–ван Влит) ----------------
+
+namespace {
+
+// Рекурсивный гауссов фильтр третьего порядка (Young, van Vliet, 1995):
+// y[n] = B·x[n] + b1·y[n−1] + b2·y[n−2] + b3·y[n−3], коэффициенты уже поделены на b0.
+// Слева продолжение константой — это установившееся состояние, начальные значения
+// равны краевому пикселю. Справа проход назад начинается с хвоста прохода вперёд,
+// продолженного той же константой u (Triggs, Sdika, 2006): отклонения трёх последних
+// выходов прохода вперёд от u линейно (матрица tail) задают три начальных значения.
+struct IirGauss {
+    float B, b1, b2, b3;
+    float tail[3][3];
+
+    // Начальные значения прохода назад по трём последним выходам прохода вперёд
+    // (w1 — последний) и краевому входу u
+    void backwardInit(float w1, float w2, float w3, float u, float& y1, float& y2, float& y3) const
+    {
+        const float d1 = w1 - u, d2 = w2 - u, d3 = w3 - u;
+        y1 = u + tail[0][0] * d1 + tail[0][1] * d2 + tail[0][2] * d3;
+        y2 = u + tail[1][0] * d1 + tail[1][1] * d2 + tail[1][2] * d3;
+        y3 = u + tail[2][0] * d1 + tail[2][1] * d2 + tail[2][2] * d3;
+    }
+};
+
+IirGauss iirGauss(double sigma)
+{
+    const double q = sigma >= 2.5 ? 0.98711 * sigma - 0.96330
+                                  : 3.97156 - 4.14554 * std::sqrt(1.0 - 0.26891 * sigma);
+    const double q2 = q * q, q3 = q2 * q;
+    const double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+    const double b1 = (2.44413 * q + 2.85619 * q2 + 1.26661 * q3) / b0;
+    const double b2 = -(1.4281 * q2 + 1.26661 * q3) / b0;
+    const double b3 = 0.422205 * q3 / b0;
+    const double B = 1.0 - (b1 + b2 + b3);
+    IirGauss g{ float(B), float(b1), float(b2), float(b3), {} };
+
+    // Матрица хвоста: единичное отклонение одного из трёх последних выходов, хвост
+    // прохода вперёд с нулевым входом и проход назад по нему. Хвост затухает за
+    // несколько sigma; считается один раз, на пиксель не влияет.
+    const int L = int(10.0 * sigma) + 32;
+    for (int j=0; j<3; ++j) {
+        std::vector<double> f(size_t(L) + 3, 0.0), y(size_t(L) + 6, 0.0);
+        f[2 - j] = 1.0;                       // f[2] — последний выход, f[0] — третий с конца
+        for (int i=3; i<L+3; ++i) f[i] = b1 * f[i-1] + b2 * f[i-2] + b3 * f[i-3];
+        for (int i=L+2; i>=3; --i) y[i] = B * f[i] + b1 * y[i+1] + b2 * y[i+2] + b3 * y[i+3];
+        for (int k=0; k<3; ++k) g.tail[k][j] = float(y[size_t(3 + k)]);
+    }
+    return g;
+}
+
+// Проход вперёд и назад по строке на месте
+void iirRow(float* p, int n, const IirGauss& g)
+{
+    const float u = p[n - 1];
+    float y1 = p[0], y2 = p[0], y3 = p[0];
+    for (int i=0; i<n; ++i) {
+        const float y = g.B * p[i] + g.b1 * y1 + g.b2 * y2 + g.b3 * y3;
+        p[i] = y; y3 = y2; y2 = y1; y1 = y;
+    }
+    g.backwardInit(y1, y2, y3, u, y1, y2, y3);
+    for (int i=n-1; i>=0; --i) {
+        const float y = g.B * p[i] + g.b1 * y1 + g.b2 * y2 + g.b3 * y3;
+        p[i] = y; y3 = y2; y2 = y1; y1 = y;
+    }
+}
+
+const int kBlurColumns = 256;   // столбцов в полосе прохода по столбцам
+
+} // namespace
+
+QImage gaussianBlur(const QImage& gray, double sigma)
+{
+    const int w = gray.width(), h = gray.height();
+    if (w==0 || h==0) return QImage();
+    if (sigma < 0.5) return gray;
+    const IirGauss g = iirGauss(sigma);
+    std::vector<float> buf(size_t(w) * h);
+
+    // 1) строки независимы
+    Parallel::forRange(0, h, Parallel::rowsPerBand(w), [&](int yb, int ye) {
+        for (int y=yb; y<ye; ++y) {
+            const uchar* s = rowPtr(gray, y);
+            float* p = &buf[size_t(y) * w];
+            for (int x=0; x<w; ++x) p[x] = s[x];
+            iirRow(p, w, g);
+        }
+    });
+
+    // 2) полосы столбцов независимы; внутри полосы строки идут подряд, так что
+    //    рекурсия идёт сразу по всем столбцам полосы и векторизуется. Проход
+    //    назад сразу округляет результат.
+    QImage out(w, h, QImage::Format_Grayscale8);
+    const RowWriter dst(out);
+    Parallel::forRange(0, w, kBlurColumns, [&](int c0, int c1) {
+        const int n = c1 - c0;
+        auto rowAt = [&](int y) { return &buf[size_t(y) * w + c0]; };
+        const std::vector<float> u(rowAt(h - 1), rowAt(h - 1) + n);   // нижний край до прохода
+        std::vector<float> e1(rowAt(0), rowAt(0) + n), e2(n), e3(n);
+
+        // вперёд: выше первой строки — её копии
+        const float* p1 = e1.data();
+        const float* p2 = p1;
+        const float* p3 = p1;
+        for (int y=0; y<h; ++y) {
+            float* r = rowAt(y);
+            for (int x=0; x<n; ++x)
+                r[x] = g.B * r[x] + g.b1 * p1[x] + g.b2 * p2[x] + g.b3 * p3[x];
+            p3 = p2; p2 = p1; p1 = r;
+        }
+
+        // назад: ниже последней строки — хвост прохода вперёд
+        for (int x=0; x<n; ++x) {
+            float y1, y2, y3;
+            g.backwardInit(p1[x], p2[x], p3[x], u[x], y1, y2, y3);
+            e1[x] = y1; e2[x] = y2; e3[x] = y3;
+        }
+        p1 = e1.data(); p2 = e2.data(); p3 = e3.data();
+        for (int y=h-1; y>=0; --y) {
+            float* r = rowAt(y);
+            uchar* d = dst(y) + c0;
+            for (int x=0; x<n; ++x) {
+                r[x] = g.B * r[x] + g.b1 * p1[x] + g.b2 * p2[x] + g.b3 * p3[x];
+                d[x] = uchar(std::min(255.0f, std::max(0.0f, r[x] + 0.5f)));
+            }
+            p3 = p2; p2 = p1; p1 = r;
+        }
+    });
     return out;
 }
 
-QImage thresholdIterative(const QImage& gray)
+// ---------------- Медианный фильтр (Перро–Эбер) ----------------
+
+namespace {
+
+// Отражение индекса с периодом 2n — при радиусе больше размера изображения
+inline int mirror(int i, int n)
+{
+    if (n == 1) return 0;
+    const int period = 2 * n;
+    i %= period;
+    if (i < 0) i += period;
+    return i < n ? i : period - 1 - i;
+}
+
+// Гистограммы в два уровня: 16 грубых корзин (старшие 4 бита) и 256 точных.
+// Медиана ищется по грубым, затем в одной корзине точных
+constexpr int kCoarse = 16;
+
+// Гистограммы столбцов — по 512 байт на столбец, поэтому изображение идёт
+// вертикальными плитками: гистограммы плитки (с полями по r столбцов) держатся в L2
+constexpr int kMedianTile = 256;
+
+// Плитка [x0, x1) x [yb, ye): у каждого столбца — гистограмма 2r+1 строк вокруг текущей,
+// при переходе на строку ниже в неё входит одна строка и выходит одна. Гистограмма
+// окна вдоль строки сдвигается так же: +столбец справа, −столбец слева. Грубая
+// часть (16 корзин) обновляется на каждом шаге, точная корзина — лениво, только
+// когда в неё попала медиана: либо догоняется по пропущенным столбцам, либо, если
+// отстала больше чем на окно, собирается заново. Медиана редко меняет корзину,
+// поэтому работа на пиксель не растёт с радиусом.
+void medianTile(const QImage& gray, const RowWriter& dst, int r, int x0, int x1, int yb, int ye)
 {
     const int w = gray.width(), h = gray.height();
-    long long sum = 0;
-    for (int y=0; y<h; ++y) {
-        const uchar* p = rowPtr(gray, y);
-        for (int x=0; x<w; ++x) sum += p[x];
+    const int n = 2 * r + 1;
+    const quint32 half = quint32(n) * n / 2;   // медиана — элемент с этим номером (с нуля)
+
+    // Столбцы окна с отражением: col[j - x0 + r + 1] — столбец для позиции j в [x0-r-1, x1+r],
+    // гистограммы хранятся для отрезка изображения [cLo, cHi], который они покрывают
+    std::vector<int> col(size_t(x1 - x0) + 2 * r + 2);
+    int cLo = w, cHi = -1;
+    for (int j = x0 - r - 1; j <= x1 + r; ++j) {
+        const int c = mirror(j, w);
+        col[size_t(j - x0 + r + 1)] = c;
+        cLo = std::min(cLo, c);
+        cHi = std::max(cHi, c);
     }
-    double T = double(sum) / (w*h);
+    for (int& c : col) c -= cLo;
+    auto colAt = [&](int j) { return col[size_t(j - x0 + r + 1)]; };
+    const int cw = cHi - cLo + 1;
 
-    for (int iter=0; iter<50; ++iter) {
-        double m1=0, m2=0; int c1=0, c2=0;
-        for (int y=0; y<h; ++y) {
-            const uchar* p = rowPtr(gray, y);
-            for (int x=0; x<w; ++x) {
-                if (p[x] <= T) { m1 += p[x]; ++c1; }
-                else           { m2 += p[x]; ++c2; }
+    std::vector<quint16> colCoarse(size_t(cw) * kCoarse, 0);
+    std::vector<quint16> colFine(size_t(cw) * 256, 0);
+    auto addRow = [&](int y, int delta) {
+        const uchar* s = gray.constScanLine(mirror(y, h)) + cLo;
+        for (int c=0; c<cw; ++c) {
+            colCoarse[size_t(c) * kCoarse + (s[c] >> 4)] += quint16(delta);
+            colFine[size_t(c) * 256 + s[c]] += quint16(delta);
+        }
+    };
+    for (int k = -r; k <= r; ++k) addRow(yb + k, 1);
+
+    std::array<quint32, kCoarse> coarse;
+    std::array<quint32, 256> fine;
+    std::array<int, kCoarse> synced;          // x, для которого собрана точная корзина
+    for (int y=yb; y<ye; ++y) {
+        if (y > yb) {
+            addRow(y - r - 1, -1);
+            addRow(y + r, 1);
+        }
+        coarse.fill(0);
+        for (int j = x0 - r; j <= x0 + r; ++j) {
+            const quint16* c = &colCoarse[size_t(colAt(j)) * kCoarse];
+            for (int b=0; b<kCoarse; ++b) coarse[b] += c[b];
+        }
+        synced.fill(std::numeric_limits<int>::min() / 2);
+
+        uchar* d = dst(y);
+        for (int x=x0; x<x1; ++x) {
+            if (x > x0) {
+                const quint16* in = &colCoarse[size_t(colAt(x + r)) * kCoarse];
+                const quint16* outc = &colCoarse[size_t(colAt(x - r - 1)) * kCoarse];
+                for (int b=0; b<kCoarse; ++b) coarse[b] += quint32(in[b]) - outc[b];
+            }
+            // грубая корзина медианы
+            int b = 0;
+            quint32 below = 0;
+            while (below + coarse[b] <= half) below += coarse[b++];
+
+            // точная корзина b — догнать до x или собрать заново
+            quint32* f = &fine[size_t(b) * 16];
+            if (x - synced[b] > n) {
+                std::fill(f, f + 16, 0u);
+                for (int j = x - r; j <= x + r; ++j) {
+                    const quint16* c = &colFine[size_t(colAt(j)) * 256 + b * 16];
+                    for (int i=0; i<16; ++i) f[i] += c[i];
+                }
+            } else {
+                for (int t = synced[b] + 1; t <= x; ++t) {
+                    const quint16* in = &colFine[size_t(colAt(t + r)) * 256 + b * 16];
+                    const quint16* outc = &colFine[size_t(colAt(t - r - 1)) * 256 + b * 16];
+                    for (int i=0; i<16; ++i) f[i] += quint32(in[i]) - outc[i];
+                }
             }
+            synced[b] = x;
+
+            int v = 0;
+            while (below + f[v] <= half) below += f[v++];
+            d[x] = uchar(b * 16 + v);
         }
-        if (c1==0 || c2==0) break;
-        const double newT = 0.5 * (m1/c1 + m2/c2);
-        if (qFabs(newT - T) < 0.5) { T = newT; break; }
-        T = newT;
     }
+}
+
+} // namespace
+
+QImage medianFilter(const QImage& gray, int radius)
+{
+    const int w = gray.width(), h = gray.height();
+    if (w==0 || h==0) return QImage();
+    if (radius <= 0) return gray;
+    radius = std::min(radius, kMaxMedianRadius);
 
     QImage out(w, h, QImage::Format_Grayscale8);
-    for (int y=0; y<h; ++y) {
-        const uchar* s = rowPtr(gray, y);
-        uchar* d = rowPtr(out, y);
-        for (int x=0; x<w; ++x) d[x] = (s[x] > T) ? 255 : 0;
-    }
+    // Полоса начинается со сборки гистограмм столбцов из 2r+1 строк — полосы
+    // не короче нескольких окон, чтобы эта сборка не росла с радиусом на пиксель
+    const int minRows = std::max(Parallel::rowsPerBand(w), 4 * (2 * radius + 1));
+    const RowWriter dst(out);
+    Parallel::forRange(0, h, minRows, [&](int yb, int ye) {
+        for (int x0 = 0; x0 < w; x0 += kMedianTile)
+            medianTile(gray, dst, radius, x0, std::min(w, x0 + kMedianTile), yb, ye);
+    });
     return out;
 }
 
-QImage thresholdMean(const QImage& gray)
+// ---------------- Сегментация ----------------
+
+QImage edgesSobel(const QImage& gray, int threshold, MaskFormat format)
 {
-    const int w = gray.width();
-    const int h = gray.height();
-    long long sum = 0;
+    const int w = gray.width(), h = gray.height();
+    QImage out = makeMask(w, h, format);
 
-    for (int y = 0; y < h; ++y) {
-        const uchar* p = gray.constScanLine(y);
-        for (int x = 0; x < w; ++x)
-            sum += p[x];
-    }
+    sweep3x3<uchar>(gray, out, [&](const uchar* r0, const uchar* r1, const uchar* r2, int xl, int xc, int xr) {
+        return uchar((sobelMagAt(r0, r1, r2, xl, xc, xr) >= threshold) ? 255 : 0);
+    }, FastMask{ Simd::kernels3x3().sobel, threshold });
+    return out;
+}
 
-    double mean = double(sum) / (w * h);
+QImage linesKernels(const QImage& gray, int threshold, MaskFormat format)
+{
+    const int w = gray.width(), h = gray.height();
+    QImage out = makeMask(w, h, format);
 
-    QImage out(w, h, QImage::Format_Grayscale8);
-    for (int y = 0; y < h; ++y) {
-        const uchar* p = gray.constScanLine(y);
-        uchar* o = out.scanLine(y);
-        for (int x = 0; x < w; ++x)
-            o[x] = (p[x] > mean) ? 255 : 0;
-    }
+    sweep3x3<uchar>(gray, out, [&](const uchar* r0, const uchar* r1, const uchar* r2, int xl, int xc, int xr) {
+        return uchar((linesRespAt(r0, r1, r2, xl, xc, xr) >= threshold) ? 255 : 0);
+    }, FastMask{ Simd::kernels3x3().lines, threshold });
+    return out;
+}
+
+QImage pointsLaplacian(const QImage& gray, int threshold, MaskFormat format)
+{
+    const int w = gray.width(), h = gray.height();
+    QImage out = makeMask(w, h, format);
 
+    sweep3x3<uchar>(gray, out, [&](const uchar* r0, const uchar* r1, const uchar* r2, int xl, int xc, int xr) {
+        return uchar((laplacianRespAt(r0, r1, r2, xl, xc, xr) >= threshold) ? 255 : 0);
+    }, FastMask{ Simd::kernels3x3().laplacian, threshold });
     return out;
 }
 
+// ---------------- Совмещённый проход ----------------
 
+Detections detectFused(const QImage& gray, int which, const DetectorThresholds& th)
+{
+    const int w = gray.width(), h = gray.height();
+    Detections res;
+    if (w == 0 || h == 0) return res;
 
-// ---------------- Сегментация ----------------
+    if (which & DetectSobel)     res.sobel     = QImage(w, h, QImage::Format_Grayscale8);
+    if (which & DetectLines)     res.lines     = QImage(w, h, QImage::Format_Grayscale8);
+    if (which & DetectPoints)    res.points    = QImage(w, h, QImage::Format_Grayscale8);
+    if (which & DetectDirection) res.direction = QImage(w, h, QImage::Format_Grayscale8);
+
+    // Для незапрошенных выходов строки — нулевые указатели
+    const RowWriter outS(res.sobel), outL(res.lines), outP(res.points), outD(res.direction);
+    const Simd::Fused3Fn fast = Simd::kernels3x3().fused;
+
+    Parallel::forRange(0, h, Parallel::rowsPerBand(w), [&](int yb, int ye) {
+        for (int y=yb; y<ye; ++y) {
+            const uchar* r0 = rowPtr(gray, refl(y-1, h));
+            const uchar* r1 = rowPtr(gray, y);
+            const uchar* r2 = rowPtr(gray, refl(y+1, h));
+
+            Simd::FusedRow row;
+            row.sobel  = outS(y);
+            row.lines  = outL(y);
+            row.points = outP(y);
+            row.sobelThreshold = th.sobel;
+            row.lineThreshold  = th.lines;
+            row.pointThreshold = th.points;
+            uchar* dir = outD(y);
+
+            auto masksAt = [&](int x, int xl, int xc, int xr) {
+                if (row.sobel)  row.sobel[x]  = (sobelMagAt(r0, r1, r2, xl, xc, xr) >= th.sobel) ? 255 : 0;
+                if (row.lines)  row.lines[x]  = (linesRespAt(r0, r1, r2, xl, xc, xr) >= th.lines) ? 255 : 0;
+                if (row.points) row.points[x] = (laplacianRespAt(r0, r1, r2, xl, xc, xr) >= th.points) ? 255 : 0;
+                if (dir)        dir[x]        = directionAt(r0, r1, r2, xl, xc, xr);
+            };
+
+            masksAt(0, refl(-1, w), 0, refl(1, w));
+            if (w > 1) masksAt(w-1, w-2, w-1, refl(w, w));
+
+            // Внутренняя часть: маски — векторно, направление и хвост — скалярно,
+            // пока три строки окрестности ещё в кэше
+            int x = (row.sobel || row.lines || row.points) ? fast(r0, r1, r2, row, 1, w-1) : w-1;
+            if (dir)
+                for (int xx=1; xx<w-1; ++xx) dir[xx] = directionAt(r0, r1, r2, xx-1, xx, xx+1);
+            for (; x<w-1; ++x) {
+                if (row.sobel)  row.sobel[x]  = (sobelMagAt(r0, r1, r2, x-1, x, x+1) >= th.sobel) ? 255 : 0;
+                if (row.lines)  row.lines[x]  = (linesRespAt(r0, r1, r2, x-1, x, x+1) >= th.lines) ? 255 : 0;
+                if (row.points) row.points[x] = (laplacianRespAt(r0, r1, r2, x-1, x, x+1) >= th.points) ? 255 : 0;
+            }
+        }
+    });
+    return res;
+}
 
-QImage edgesSobel(const QImage& gray, int threshold)
+// ---------------- Карты откликов ----------------
+
+QImage sobelMagnitude(const QImage& gray)
 {
-    static const int kx[9] = { -1,0,1, -2,0,2, -1,0,1 };
-    static const int ky[9] = { -1,-2,-1, 0,0,0, 1,2,1 };
-    const std::vector<int> Kx(kx, kx+9);
-    const std::vector<int> Ky(ky, ky+9);
+    QImage out(gray.width(), gray.height(), QImage::Format_Grayscale16);
+    sweep3x3<quint16>(gray, out, [](const uchar* r0, const uchar* r1, const uchar* r2, int xl, int xc, int xr) {
+        return quint16(sobelMagAt(r0, r1, r2, xl, xc, xr));
+    }, Simd::kernels3x3().sobelMagnitude);
+    return out;
+}
 
-    const int w = gray.width(), h = gray.height();
-    QImage out(w, h, QImage::Format_Grayscale8);
+QImage linesResponse(const QImage& gray)
+{
+    QImage out(gray.width(), gray.height(), QImage::Format_Grayscale16);
+    sweep3x3<quint16>(gray, out, [](const uchar* r0, const uchar* r1, const uchar* r2, int xl, int xc, int xr) {
+        return quint16(linesRespAt(r0, r1, r2, xl, xc, xr));
+    }, Simd::kernels3x3().linesResponse);
+    return out;
+}
 
-    for (int y=0; y<h; ++y) {
-        uchar* d = rowPtr(out, y);
-        for (int x=0; x<w; ++x) {
-            const int gx = convAtSigned(gray, Kx, 3, 3, x, y);
-            const int gy = convAtSigned(gray, Ky, 3, 3, x, y);
-            const int mag = int(std::hypot(double(gx), double(gy)));
-            d[x] = (mag >= threshold) ? 255 : 0;
+QImage laplacianResponse(const QImage& gray)
+{
+    QImage out(gray.width(), gray.height(), QImage::Format_Grayscale16);
+    sweep3x3<quint16>(gray, out, [](const uchar* r0, const uchar* r1, const uchar* r2, int xl, int xc, int xr) {
+        return quint16(laplacianRespAt(r0, r1, r2, xl, xc, xr));
+    }, Simd::kernels3x3().laplacianResponse);
+    return out;
+}
+
+QImage thresholdResponse(const QImage& response, int threshold, MaskFormat format)
+{
+    const int w = response.width(), h = response.height();
+    QImage out = makeMask(w, h, format);
+    const RowWriter dst(out);
+    const bool packed = isPacked(out);
+    const Simd::Threshold16Fn fast = Simd::kernels3x3().threshold16;
+    Parallel::forRange(0, h, Parallel::rowsPerBand(w), [&](int yb, int ye) {
+        std::vector<uchar> scratch(packed ? w : 0);
+        for (int y=yb; y<ye; ++y) {
+            const quint16* s = reinterpret_cast<const quint16*>(response.constScanLine(y));
+            uchar* d = packed ? scratch.data() : dst(y);
+            for (int x = fast(s, d, w, threshold); x<w; ++x)
+                d[x] = (s[x] >= threshold) ? 255 : 0;
+            if (packed) packRow(d, dst(y), w);
         }
-    }
+    });
     return out;
 }
 
-QImage linesKernels(const QImage& gray, int threshold)
+// ---------------- Детектор Канни ----------------
+
+namespace {
+
+enum : uchar { kNoEdge = 0, kWeakEdge = 1, kStrongEdge = 2 };
+
+// Операция отменена (TaskControl): полосы, пропущенные после отмены, не заполнили
+// свою часть данных, и последовательные шаги по ним идти не должны
+bool taskCancelled()
 {
-    // 3x3 ядра: гориз., верт., диагонали
-    static const int kh[9] = { -1,-1,-1,  2,2,2,  -1,-1,-1 };
-    static const int kv[9] = { -1, 2,-1, -1,2,-1, -1, 2,-1 };
-    static const int kd1[9]= {  2,-1,-1, -1,2,-1, -1,-1, 2 };
-    static const int kd2[9]= { -1,-1, 2, -1,2,-1,  2,-1,-1 };
+    const TaskControl* control = taskControl();
+    return control && control->isCancelled();
+}
 
-    const std::vector<int> Kh(kh, kh+9), Kv(kv, kv+9), Kd1(kd1, kd1+9), Kd2(kd2, kd2+9);
+// Полосы строк для union-find: по нескольку на поток, но не тоньше ~64K пикселей
+int unionBandRows(int w, int h)
+{
+    const int threads = threadCount();
+    return std::max(Parallel::rowsPerBand(w), (h + 4 * threads - 1) / (4 * threads));
+}
 
-    const int w = gray.width(), h = gray.height();
-    QImage out(w, h, QImage::Format_Grayscale8);
+// Корень без сжатия пути — для параллельного чтения после всех объединений
+template<typename Index>
+inline Index findRoot(const Index* parent, Index i)
+{
+    while (parent[i] != i) i = parent[i];
+    return i;
+}
 
-    for (int y=0; y<h; ++y) {
-        uchar* d = rowPtr(out, y);
+template<typename Index>
+inline Index findCompress(Index* parent, Index i)
+{
+    Index r = findRoot(parent, i);
+    while (parent[i] != r) {
+        const Index next = parent[i];
+        parent[i] = r;
+        i = next;
+    }
+    return r;
+}
+
+// Корень — меньший индекс, поэтому корни полосы после первого прохода лежат в ней же.
+// Класс компоненты (сильная/слабая) хранится в корне.
+template<typename Index>
+inline void uniteEdges(Index* parent, uchar* cls, Index a, Index b)
+{
+    a = findCompress(parent, a);
+    b = findCompress(parent, b);
+    if (a == b) return;
+    if (b < a) std::swap(a, b);
+    parent[b] = a;
+    cls[a] = std::max(cls[a], cls[b]);
+}
+
+// Гистерезис: компоненты 8-связности пикселей-кандидатов (cls != 0); в маску попадают
+// компоненты, где есть сильный пиксель.
+//   1) полосы строк независимо: union-find внутри полосы;
+//   2) последовательно: объединение через границы полос (одна строка на границу);
+//   3) полосы независимо: корень каждого кандидата и класс его компоненты.
+template<typename Index>
+void hysteresis(std::vector<uchar>& clsMap, int w, int h, QImage& out)
+{
+    uchar* cls = clsMap.data();
+    std::unique_ptr<Index[]> parentBuf(new Index[size_t(w) * h]);
+    Index* parent = parentBuf.get();
+    auto at = [w](int x, int y) { return Index(size_t(y) * w + x); };
+
+    // Соседи сверху: если есть верхний, левый и правый верхние уже связаны с ним
+    // (при разборе верхней строки); иначе левый и правый верхние не соседи друг другу
+    auto linkUpper = [&](int x, int y, Index i) {
+        const uchar* up = cls + size_t(y - 1) * w;
+        if (up[x]) { uniteEdges(parent, cls, i, at(x, y - 1)); return; }
+        if (x > 0 && up[x - 1])     uniteEdges(parent, cls, i, at(x - 1, y - 1));
+        if (x + 1 < w && up[x + 1]) uniteEdges(parent, cls, i, at(x + 1, y - 1));
+    };
+    // Левый сосед соседствует с верхним и левым верхним, поэтому при нём
+    // остаётся проверить только правый верхний
+    auto linkRow = [&](int y, bool withUpper) {
         for (int x=0; x<w; ++x) {
-            const int rh  = convAtSigned(gray, Kh,  3,3, x,y);
-            const int rv  = convAtSigned(gray, Kv,  3,3, x,y);
-            const int r45 = convAtSigned(gray, Kd1, 3,3, x,y);
-            const int r135= convAtSigned(gray, Kd2, 3,3, x,y);
-            const int m = std::max({ std::abs(rh), std::abs(rv), std::abs(r45), std::abs(r135) });
-            d[x] = (m >= threshold) ? 255 : 0;
+            const Index i = at(x, y);
+            if (!cls[i]) continue;
+            const bool left = x > 0 && cls[i - 1];
+            if (left) uniteEdges(parent, cls, i, Index(i - 1));
+            if (!withUpper) continue;
+            if (!left) linkUpper(x, y, i);
+            else if (x + 1 < w && cls[at(x + 1, y - 1)] && !cls[at(x, y - 1)])
+                uniteEdges(parent, cls, i, at(x + 1, y - 1));
+        }
+    };
+
+    const int bandRows = unionBandRows(w, h);
+    const int bands = (h + bandRows - 1) / bandRows;
+    Parallel::forRange(0, bands, 1, [&](int b0, int b1) {
+        for (int b = b0; b < b1; ++b) {
+            const int yb = b * bandRows, ye = std::min(h, yb + bandRows);
+            for (int y=yb; y<ye; ++y)
+                for (int x=0; x<w; ++x) parent[at(x, y)] = at(x, y);
+            for (int y=yb; y<ye; ++y) linkRow(y, y > yb);
+        }
+    });
+    // После отмены parent пропущенных полос не инициализирован
+    if (taskCancelled()) return;
+    for (int b = 1; b < bands; ++b) {
+        const int y = b * bandRows;
+        for (int x=0; x<w; ++x)
+            if (cls[at(x, y)]) linkUpper(x, y, at(x, y));
+    }
+
+    const RowWriter dst(out);
+    const bool packed = isPacked(out);
+    Parallel::forRange(0, h, Parallel::rowsPerBand(w), [&](int yb, int ye) {
+        std::vector<uchar> scratch(packed ? w : 0);
+        for (int y=yb; y<ye; ++y) {
+            uchar* d = packed ? scratch.data() : dst(y);
+            const uchar* c = cls + size_t(y) * w;
+            for (int x=0; x<w; ++x) {
+                // соседи по строке в одной компоненте — корень не ищется повторно
+                if (!c[x])                  d[x] = 0;
+                else if (x > 0 && c[x - 1]) d[x] = d[x - 1];
+                else                        d[x] = cls[findRoot(parent, at(x, y))] == kStrongEdge ? 255 : 0;
+            }
+            if (packed) packRow(d, dst(y), w);
+        }
+    });
+}
+
+} // namespace
+
+QImage edgesCanny(const QImage& gray, int low, int high, MaskFormat format)
+{
+    const int w = gray.width(), h = gray.height();
+    if (w==0 || h==0) return QImage();
+    if (low > high) std::swap(low, high);
+
+    // Модуль — векторным проходом Собеля; направление нужно только кандидатам
+    // (|∇| >= low), его сектор считается по знакам и отношению gy/gx без арктангенса
+    const QImage mag = sobelMagnitude(gray);
+    if (taskCancelled()) return QImage();
+
+    // Подавление немаксимумов: пиксель остаётся, если его модуль — максимум вдоль
+    // градиента (строго больше соседа «сзади», не меньше соседа «спереди»);
+    // за краем изображения модуль 0
+    std::vector<uchar> cls(size_t(w) * h);
+    const std::vector<quint16> zeros(w);
+    auto magRow = [&](int y) {
+        return (y < 0 || y >= h) ? zeros.data() : reinterpret_cast<const quint16*>(mag.constScanLine(y));
+    };
+    Parallel::forRange(0, h, Parallel::rowsPerBand(w), [&](int yb, int ye) {
+        for (int y=yb; y<ye; ++y) {
+            const quint16* m = magRow(y);
+            const quint16* mUp = magRow(y - 1);
+            const quint16* mDn = magRow(y + 1);
+            const uchar* r0 = rowPtr(gray, refl(y - 1, h));
+            const uchar* r1 = rowPtr(gray, y);
+            const uchar* r2 = rowPtr(gray, refl(y + 1, h));
+            uchar* c = &cls[size_t(y) * w];
+            for (int x=0; x<w; ++x) {
+                const int v = m[x];
+                if (v < low || v == 0) { c[x] = kNoEdge; continue; }
+                int gx, gy;
+                Stencil::sobel(gx, gy, window3(r0, r1, r2, refl(x - 1, w), x, refl(x + 1, w)));
+                // tg 22.5° ≈ 0.4142: почти горизонтальный, почти вертикальный или диагональ (y вниз)
+                const int ax = std::abs(gx), ay = std::abs(gy);
+                int dx = 1;
+                const quint16* back = m;
+                const quint16* ahead = m;
+                if (ay * 10000 > ax * 4142) {
+                    dx = ay * 10000 > ax * 24142 ? 0 : ((gx ^ gy) < 0 ? -1 : 1);
+                    back = mUp;
+                    ahead = mDn;
+                }
+                const int xb = x - dx, xa = x + dx;
+                const int vb = (xb < 0 || xb >= w) ? 0 : back[xb];
+                const int va = (xa < 0 || xa >= w) ? 0 : ahead[xa];
+                const bool peak = v > vb && v >= va;
+                c[x] = !peak ? kNoEdge : (v >= high ? kStrongEdge : kWeakEdge);
+            }
+        }
+    });
+
+    if (taskCancelled()) return QImage();
+
+    QImage out = makeMask(w, h, format);
+    if (qint64(w) * h <= std::numeric_limits<quint32>::max())
+        hysteresis<quint32>(cls, w, h, out);
+    else
+        hysteresis<quint64>(cls, w, h, out);
+    return taskCancelled() ? QImage() : out;
+}
+
+// ---------------- Связные компоненты ----------------
+
+namespace {
+
+// Объединение двух классов эквивалентности; корень — меньший индекс
+template<typename Index>
+inline void uniteLabels(Index* parent, Index a, Index b)
+{
+    a = findCompress(parent, a);
+    b = findCompress(parent, b);
+    if (a == b) return;
+    if (b < a) std::swap(a, b);
+    parent[b] = a;
+}
+
+// Накопитель статистики одной компоненты
+struct ComponentAcc {
+    qint64 area = 0;
+    qint64 sumX = 0, sumY = 0;
+    int x0 = std::numeric_limits<int>::max(), y0 = std::numeric_limits<int>::max();
+    int x1 = -1, y1 = -1;
+
+    void add(const ComponentAcc& o)
+    {
+        area += o.area;
+        sumX += o.sumX;
+        sumY += o.sumY;
+        x0 = std::min(x0, o.x0); y0 = std::min(y0, o.y0);
+        x1 = std::max(x1, o.x1); y1 = std::max(y1, o.y1);
+    }
+};
+
+// Строка маски как 0/1 в буфере с полем в один пиксель слева и два справа
+// (соседи блоков за краем — фон); y вне изображения — строка фона
+const uchar* foregroundRow(const QImage& mask, int y, bool white, std::vector<uchar>& buf)
+{
+    const int w = mask.width();
+    buf.assign(size_t(w) + 3, 0);
+    if (y < 0 || y >= mask.height()) return buf.data() + 1;
+    uchar* d = buf.data() + 1;
+    const uchar* s = mask.constScanLine(y);
+    const uchar on = white ? 1 : 0;
+    if (isPacked(mask)) {
+        for (int x=0; x<w; ++x) d[x] = ((s[x >> 3] >> (x & 7)) & 1) == on;
+    } else {
+        for (int x=0; x<w; ++x) d[x] = (s[x] >> 7) == on;
+    }
+    return d;
+}
+
+// Разметка блоками 2x2 (Grana и др.): пиксели блока 8-связны между собой, поэтому
+// union-find работает с блоками — вчетверо меньше меток и объединений. Блок X
+// связан с соседним, если соседствуют их пиксели переднего плана:
+//   слева   — правый столбец левого блока и левый столбец X;
+//   сверху  — нижняя строка верхнего блока и верхняя строка X;
+//   по диагонали — угловые пиксели (левый верхний / правый верхний).
+// Первый проход — полосами блочных строк параллельно, затем последовательное
+// слияние на границах полос; второй проход нумерует корни по порядку и собирает
+// статистику полос.
+template<typename Index>
+Components labelBlocks(const QImage& mask, bool white, bool withLabels)
+{
+    const int w = mask.width(), h = mask.height();
+    const int bw = (w + 1) / 2, bh = (h + 1) / 2;
+    const size_t blocks = size_t(bw) * bh;
+    std::unique_ptr<Index[]> parentBuf(new Index[blocks]);
+    Index* parent = parentBuf.get();
+    std::vector<uchar> isFg(blocks);
+    auto at = [bw](int bx, int by) { return Index(size_t(by) * bw + bx); };
+
+    // Связи блочной строки by с верхней: prev — пиксельная строка 2by-1, top — 2by
+    auto linkUpper = [&](int by, const uchar* prev, const uchar* top) {
+        for (int bx=0; bx<bw; ++bx) {
+            const Index i = at(bx, by);
+            if (!isFg[i]) continue;
+            const int x = 2 * bx;
+            const bool t0 = top[x], t1 = top[x + 1];
+            if ((t0 || t1) && (prev[x] || prev[x + 1])) uniteLabels(parent, i, at(bx, by - 1));
+            if (t0 && prev[x - 1])                      uniteLabels(parent, i, at(bx - 1, by - 1));
+            if (t1 && prev[x + 2])                      uniteLabels(parent, i, at(bx + 1, by - 1));
+        }
+    };
+
+    const int bandBlocks = std::max(1, unionBandRows(w, h) / 2);
+    const int bands = (bh + bandBlocks - 1) / bandBlocks;
+    Parallel::forRange(0, bands, 1, [&](int b0, int b1) {
+        std::vector<uchar> buf0, buf1, bufPrev;
+        for (int b = b0; b < b1; ++b) {
+            const int byb = b * bandBlocks, bye = std::min(bh, byb + bandBlocks);
+            for (int by=byb; by<bye; ++by) {
+                const uchar* r0 = foregroundRow(mask, 2 * by, white, buf0);
+                const uchar* r1 = foregroundRow(mask, 2 * by + 1, white, buf1);
+                for (int bx=0; bx<bw; ++bx) {
+                    const Index i = at(bx, by);
+                    const int x = 2 * bx;
+                    parent[i] = i;
+                    isFg[i] = r0[x] | r0[x + 1] | r1[x] | r1[x + 1];
+                    if (isFg[i] && (r0[x - 1] || r1[x - 1]) && (r0[x] || r1[x]))
+                        uniteLabels(parent, i, Index(i - 1));
+                }
+                if (by > byb) linkUpper(by, bufPrev.data() + 1, r0);
+                std::swap(bufPrev, buf1);
+            }
+        }
+    });
+    // После отмены parent и isFg пропущенных полос не заполнены
+    if (taskCancelled()) return Components();
+    {
+        std::vector<uchar> bufPrev, bufTop;
+        for (int b = 1; b < bands; ++b) {
+            const int by = b * bandBlocks;
+            linkUpper(by, foregroundRow(mask, 2 * by - 1, white, bufPrev),
+                      foregroundRow(mask, 2 * by, white, bufTop));
+        }
+    }
+
+    // Нумерация: корни получают метки 1..n по порядку полос, затем по порядку блоков
+    std::vector<quint32> firstLabel(size_t(bands) + 1, 1);
+    Parallel::forRange(0, bands, 1, [&](int b0, int b1) {
+        for (int b = b0; b < b1; ++b) {
+            const Index i0 = at(0, b * bandBlocks), i1 = at(0, std::min(bh, (b + 1) * bandBlocks));
+            quint32 roots = 0;
+            for (Index i = i0; i < i1; ++i) roots += isFg[i] && parent[i] == i;
+            firstLabel[b + 1] = roots;
+        }
+    });
+    if (taskCancelled()) return Components();
+    for (int b = 0; b < bands; ++b) firstLabel[b + 1] += firstLabel[b];
+    const quint32 count = firstLabel[bands] - 1;
+
+    std::unique_ptr<quint32[]> labelBuf(new quint32[blocks]);
+    quint32* label = labelBuf.get();
+    Parallel::forRange(0, bands, 1, [&](int b0, int b1) {
+        for (int b = b0; b < b1; ++b) {
+            const Index i0 = at(0, b * bandBlocks), i1 = at(0, std::min(bh, (b + 1) * bandBlocks));
+            quint32 next = firstLabel[b];
+            for (Index i = i0; i < i1; ++i)
+                if (isFg[i] && parent[i] == i) label[i] = next++;
+        }
+    });
+    if (taskCancelled()) return Components();
+
+    // Второй проход: метки блоков, пикселей и статистика. Метки корней полосы —
+    // непрерывный диапазон, их накопители пишутся прямо в общий массив; компоненты,
+    // пришедшие из верхних полос, копятся отдельно и сливаются после прохода
+    Components res;
+    res.width = w;
+    res.height = h;
+    if (withLabels) res.labels.assign(size_t(w) * h, 0);
+    std::vector<ComponentAcc> acc(size_t(count) + 1);
+    std::vector<std::unordered_map<quint32, ComponentAcc>> foreign(bands);
+    Parallel::forRange(0, bands, 1, [&](int b0, int b1) {
+        std::vector<uchar> buf0, buf1;
+        for (int b = b0; b < b1; ++b) {
+            auto& outside = foreign[b];
+            ComponentAcc* cur = nullptr;
+            quint32 curLabel = 0;
+            const int byb = b * bandBlocks, bye = std::min(bh, byb + bandBlocks);
+            for (int by=byb; by<bye; ++by) {
+                const uchar* r0 = foregroundRow(mask, 2 * by, white, buf0);
+                const uchar* r1 = foregroundRow(mask, 2 * by + 1, white, buf1);
+                for (int bx=0; bx<bw; ++bx) {
+                    const Index i = at(bx, by);
+                    if (!isFg[i]) continue;
+                    // label только читается: его пишет лишь нумерация корней, и другие
+                    // полосы читают метки корней этой полосы в том же проходе
+                    const quint32 L = label[parent[i] == i ? i : findRoot(parent, i)];
+                    if (L != curLabel) {
+                        curLabel = L;
+                        cur = L >= firstLabel[b] ? &acc[L] : &outside[L];
+                    }
+                    // Пиксели блока одной маской: площадь, суммы координат и
+                    // крайние столбцы/строки без ветвлений по пикселям
+                    const int x = 2 * bx, y = 2 * by;
+                    const int left = r0[x] + r1[x], right = r0[x + 1] + r1[x + 1];
+                    const int top = r0[x] + r0[x + 1], bottom = r1[x] + r1[x + 1];
+                    const int n = left + right;
+                    cur->area += n;
+                    cur->sumX += qint64(n) * x + right;
+                    cur->sumY += qint64(n) * y + bottom;
+                    cur->x0 = std::min(cur->x0, left ? x : x + 1);
+                    cur->x1 = std::max(cur->x1, right ? x + 1 : x);
+                    cur->y0 = std::min(cur->y0, top ? y : y + 1);
+                    cur->y1 = std::max(cur->y1, bottom ? y + 1 : y);
+                    if (withLabels) {
+                        quint32* l0 = &res.labels[size_t(y) * w + x];
+                        l0[0] = r0[x] ? L : 0;
+                        if (x + 1 < w) l0[1] = r0[x + 1] ? L : 0;
+                        if (y + 1 < h) {
+                            l0[w] = r1[x] ? L : 0;
+                            if (x + 1 < w) l0[w + 1] = r1[x + 1] ? L : 0;
+                        }
+                    }
+                }
+            }
         }
+    });
+    if (taskCancelled()) return Components();
+    for (const auto& part : foreign)
+        for (const auto& e : part) acc[e.first].add(e.second);
+
+    res.list.resize(count);
+    for (quint32 L = 1; L <= count; ++L) {
+        const ComponentAcc& a = acc[L];
+        Component& c = res.list[L - 1];
+        c.area = a.area;
+        c.bounds = QRect(QPoint(a.x0, a.y0), QPoint(a.x1, a.y1));
+        c.centroid = QPointF(double(a.sumX) / a.area, double(a.sumY) / a.area);
     }
+    return res;
+}
+
+} // namespace
+
+Components labelComponents(const QImage& mask, bool white, bool withLabels)
+{
+    if (mask.isNull()) return Components();
+    const QImage src = (isPacked(mask) || mask.format() == QImage::Format_Grayscale8) ? mask : toGrayscale(mask);
+    const qint64 blocks = qint64((src.width() + 1) / 2) * ((src.height() + 1) / 2);
+    if (blocks <= std::numeric_limits<quint32>::max())
+        return labelBlocks<quint32>(src, white, withLabels);
+    return labelBlocks<quint64>(src, white, withLabels);
+}
+
+// ---------------- Морфология двоичных масок ----------------
+
+namespace {
+
+// Маска как битовая плоскость: строка — 64-битные слова, пиксель x — бит x&63
+// слова x>>6 (раскладка MonoLSB, прочитанная little-endian), 1 — белый.
+// Биты за шириной всегда нулевые: сдвиги вносят их в строку как фон.
+struct BitPlane {
+    int w = 0, h = 0;
+    int words = 0;
+    std::vector<quint64> bits;
+
+    BitPlane(int width, int height)
+        : w(width), h(height), words((width + 63) / 64), bits(size_t(words) * height) {}
+    quint64* row(int y) { return bits.data() + size_t(y) * words; }
+    const quint64* row(int y) const { return bits.data() + size_t(y) * words; }
+    quint64 tailMask() const { return (w & 63) ? (quint64(1) << (w & 63)) - 1 : ~quint64(0); }
+};
+
+BitPlane loadPlane(const QImage& mask)
+{
+    BitPlane p(mask.width(), mask.height());
+    const bool packed = isPacked(mask);
+    Parallel::forRange(0, p.h, Parallel::rowsPerBand(p.w), [&](int yb, int ye) {
+        std::vector<uchar> buf(size_t(p.words) * 8);
+        for (int y=yb; y<ye; ++y) {
+            std::fill(buf.begin(), buf.end(), uchar(0));
+            if (packed) std::memcpy(buf.data(), mask.constScanLine(y), size_t(p.w + 7) / 8);
+            else        packRow(mask.constScanLine(y), buf.data(), p.w);
+            quint64* d = p.row(y);
+            for (int i=0; i<p.words; ++i) d[i] = qFromLittleEndian<quint64>(buf.data() + 8 * i);
+            d[p.words - 1] &= p.tailMask();
+        }
+    });
+    return p;
+}
+
+QImage storePlane(const BitPlane& p, Img::MaskFormat format)
+{
+    QImage out = makeMask(p.w, p.h, format);
+    const RowWriter dst(out);
+    Parallel::forRange(0, p.h, Parallel::rowsPerBand(p.w), [&](int yb, int ye) {
+        std::vector<uchar> buf(size_t(p.words) * 8);
+        for (int y=yb; y<ye; ++y) {
+            const quint64* s = p.row(y);
+            for (int i=0; i<p.words; ++i) qToLittleEndian(s[i], buf.data() + 8 * i);
+            if (format == Img::MaskFormat::Mono) {
+                std::memcpy(dst(y), buf.data(), size_t(p.w + 7) / 8);
+                continue;
+            }
+            uchar* d = dst(y);
+            for (int x=0; x<p.w; ++x) d[x] = ((buf[x >> 3] >> (x & 7)) & 1) ? 255 : 0;
+        }
+    });
     return out;
 }
 
-QImage pointsLaplacian(const QImage& gray, int threshold)
+// Дополнение маски; биты за шириной остаются нулями
+void invertPlane(BitPlane& p)
 {
-    // Классический 3x3 Лаплас (8-соседство)
-    static const int lap[9] = { -1,-1,-1, -1,8,-1, -1,-1,-1 };
-    const std::vector<int> K(lap, lap+9);
+    const quint64 tail = p.tailMask();
+    Parallel::forRange(0, p.h, Parallel::rowsPerBand(p.w), [&](int yb, int ye) {
+        for (int y=yb; y<ye; ++y) {
+            quint64* d = p.row(y);
+            for (int i=0; i<p.words; ++i) d[i] = ~d[i];
+            d[p.words - 1] &= tail;
+        }
+    });
+}
 
-    const int w = gray.width(), h = gray.height();
-    QImage out(w, h, QImage::Format_Grayscale8);
+// dst — строка src, сдвинутая на s пикселей: бит x = бит x+s (s любого знака, снаружи нули)
+inline void shiftRow(const quint64* src, quint64* dst, int words, int s)
+{
+    const int q = s >= 0 ? s / 64 : -((63 - s) / 64);
+    const int r = s - 64 * q;
+    auto at = [&](int i) -> quint64 { return (i >= 0 && i < words) ? src[i] : 0; };
+    for (int i=0; i<words; ++i)
+        dst[i] = r ? (at(i + q) >> r) | (at(i + q + 1) << (64 - r)) : at(i + q);
+}
 
-    for (int y=0; y<h; ++y) {
-        uchar* d = rowPtr(out, y);
-        for (int x=0; x<w; ++x) {
-            const int r = convAtSigned(gray, K, 3,3, x,y);
-            d[x] = (std::abs(r) >= threshold) ? 255 : 0;
+// Горизонтальный проход: бит x результата — OR битов [x+lo, x+hi] строки (lo <= 0 <= hi).
+// Пиксели строки упакованы вдоль x, поэтому окно собирается удвоением: OR строки
+// со своим сдвигом на 1, 2, 4... и последний шаг с перекрытием — log2(длины)
+// операций над словами строки вместо длины окна. Окно вперёд [x, x+hi] и назад
+// [x+lo, x] набираются отдельно: сдвиг готового окна терял бы биты за краем строки.
+void orWindowRows(const BitPlane& src, BitPlane& dst, int lo, int hi)
+{
+    const int words = src.words;
+    const quint64 tail = src.tailMask();
+    Parallel::forRange(0, src.h, Parallel::rowsPerBand(src.w), [&](int yb, int ye) {
+        std::vector<quint64> run(words), shifted(words);
+        // run — OR окна длины len от x в направлении dir (+1 вперёд, -1 назад)
+        auto runOr = [&](const quint64* row, int len, int dir) {
+            std::copy(row, row + words, run.begin());
+            auto widen = [&](int by) {
+                shiftRow(run.data(), shifted.data(), words, dir * by);
+                for (int i=0; i<words; ++i) run[i] |= shifted[i];
+            };
+            int have = 1;
+            for (; 2 * have <= len; have *= 2) widen(have);
+            if (have < len) widen(len - have);
+        };
+        for (int y=yb; y<ye; ++y) {
+            quint64* d = dst.row(y);
+            runOr(src.row(y), hi + 1, 1);
+            std::copy(run.begin(), run.end(), d);
+            runOr(src.row(y), 1 - lo, -1);
+            for (int i=0; i<words; ++i) d[i] |= run[i];
+            d[words - 1] &= tail;
+        }
+    });
+}
+
+// Вертикальный проход: строка y результата — OR строк [y+lo, y+hi] (снаружи нули).
+// Полосы по kMorphColumns слов параллельно; короткое окно — прямой OR строк, длинное —
+// van Herk / Gil-Werman по словам, как slidingMinMaxColumns: префиксы g и суффиксы s
+// в блоках длины окна, результат = s[y] | g[y + len - 1], три операции на слово
+// при любой высоте элемента.
+constexpr int kMorphColumns = 8;
+
+void orWindowColumns(const BitPlane& src, BitPlane& dst, int lo, int hi)
+{
+    const int len = hi - lo + 1;
+    const int h = src.h;
+    auto srcRow = [&](int y) -> const quint64* { return (y >= 0 && y < h) ? src.row(y) : nullptr; };
+
+    Parallel::forRange(0, src.words, 1, [&](int c0, int c1) {
+        std::vector<quint64> g, s;
+        for (int cb = c0; cb < c1; cb += kMorphColumns) {
+            const int S = std::min(kMorphColumns, c1 - cb);
+            if (len <= 4) {
+                for (int y=0; y<h; ++y) {
+                    quint64* d = dst.row(y) + cb;
+                    std::fill(d, d + S, quint64(0));
+                    for (int k = lo; k <= hi; ++k)
+                        if (const quint64* r = srcRow(y + k))
+                            for (int c=0; c<S; ++c) d[c] |= r[cb + c];
+                }
+                continue;
+            }
+            // Расширенная последовательность: элемент j — строка lo + j, j в [0, h + len - 1)
+            const int n = h + len - 1;
+            g.resize(size_t(n) * S);
+            s.resize(size_t(n) * S);
+            for (int j=0; j<n; ++j) {
+                const quint64* r = srcRow(lo + j);
+                quint64* gj = &g[size_t(j) * S];
+                const bool start = j % len == 0;
+                for (int c=0; c<S; ++c) {
+                    const quint64 v = r ? r[cb + c] : 0;
+                    gj[c] = start ? v : (gj[c - S] | v);
+                }
+            }
+            for (int j=n-1; j>=0; --j) {
+                const quint64* r = srcRow(lo + j);
+                quint64* sj = &s[size_t(j) * S];
+                const bool end = j % len == len - 1 || j == n - 1;
+                for (int c=0; c<S; ++c) {
+                    const quint64 v = r ? r[cb + c] : 0;
+                    sj[c] = end ? v : (sj[c + S] | v);
+                }
+            }
+            for (int y=0; y<h; ++y) {
+                const quint64* sy = &s[size_t(y) * S];
+                const quint64* gy = &g[size_t(y + len - 1) * S];
+                quint64* d = dst.row(y) + cb;
+                for (int c=0; c<S; ++c) d[c] = sy[c] | gy[c];
+            }
         }
+    });
+}
+
+// OR по структурному элементу: окна [xlo, xhi] x [ylo, yhi] (прямоугольник —
+// проходом по строкам, затем по столбцам) или их объединение из двух отрезков (крест)
+BitPlane orElement(const BitPlane& a, int xlo, int xhi, int ylo, int yhi, Img::StructShape shape)
+{
+    BitPlane horiz(a.w, a.h);
+    if (xlo == 0 && xhi == 0) horiz.bits = a.bits;
+    else                      orWindowRows(a, horiz, xlo, xhi);
+    if (ylo == 0 && yhi == 0) return horiz;
+
+    BitPlane out(a.w, a.h);
+    if (shape == Img::StructShape::Rect) {
+        orWindowColumns(horiz, out, ylo, yhi);
+        return out;
     }
+    orWindowColumns(a, out, ylo, yhi);
+    Parallel::forRange(0, a.h, Parallel::rowsPerBand(a.w), [&](int yb, int ye) {
+        for (int y=yb; y<ye; ++y) {
+            quint64* d = out.row(y);
+            const quint64* hr = horiz.row(y);
+            for (int i=0; i<a.words; ++i) d[i] |= hr[i];
+        }
+    });
+    return out;
+}
+
+// Центр элемента длины n — n/2; дилатация берёт отражённый элемент, поэтому
+// размыкание и замыкание и при чётных размерах антиэкстенсивно/экстенсивно
+BitPlane dilatePlane(const BitPlane& a, int ew, int eh, Img::StructShape shape)
+{
+    return orElement(a, -(ew - 1 - ew / 2), ew / 2, -(eh - 1 - eh / 2), eh / 2, shape);
+}
+
+// Эрозия — дополнение дилатации дополнения: за краем изображения белый фон,
+// так что края маски не разъедаются
+BitPlane erodePlane(BitPlane a, int ew, int eh, Img::StructShape shape)
+{
+    invertPlane(a);
+    BitPlane out = orElement(a, -(ew / 2), ew - 1 - ew / 2, -(eh / 2), eh - 1 - eh / 2, shape);
+    invertPlane(out);
     return out;
 }
 
+} // namespace
+
+QImage morphology(const QImage& mask, MorphOp op, int width, int height, StructShape shape)
+{
+    if (mask.isNull()) return QImage();
+    width = std::max(1, width);
+    height = std::max(1, height);
+    const bool packed = isPacked(mask);
+    const BitPlane src = loadPlane(packed || mask.format() == QImage::Format_Grayscale8 ? mask : toGrayscale(mask));
+
+    BitPlane out(0, 0);
+    switch (op) {
+    case MorphOp::Erode:  out = erodePlane(src, width, height, shape); break;
+    case MorphOp::Dilate: out = dilatePlane(src, width, height, shape); break;
+    case MorphOp::Open:   out = dilatePlane(erodePlane(src, width, height, shape), width, height, shape); break;
+    case MorphOp::Close:  out = erodePlane(dilatePlane(src, width, height, shape), width, height, shape); break;
+    }
+    return storePlane(out, packed ? MaskFormat::Mono : MaskFormat::Gray8);
+}
+
+// ---------------- Преобразование Хафа ----------------
+
+namespace {
+
+constexpr int kHoughShift = 16;     // cos/sin в таблицах — с 16 дробными битами
+constexpr int kHoughBlock = 256;    // точек за раз: строка аккумулятора остаётся в кэше
+
+struct HoughPoint { int x, y; };
+
+// Углы θ = i·π/n, попавшие в секторы вокруг 0°/45°/90°/135°
+struct HoughAngles {
+    int n = 0;                      // углов на полуоборот
+    std::vector<int> index;         // i активных углов по возрастанию
+    std::vector<qint64> cosQ, sinQ; // cos/sin · 2^kHoughShift
+
+    double theta(int a) const { return M_PI * index[size_t(a)] / n; }
+};
+
+HoughAngles houghAngles(double step, double sector)
+{
+    HoughAngles t;
+    t.n = std::max(4, qRound(180.0 / std::clamp(step, 0.05, 45.0)));
+    for (int i = 0; i < t.n; ++i) {
+        const double deg = 180.0 * i / t.n;
+        const double d = std::fmod(deg, 45.0);
+        if (sector < 22.5 && std::min(d, 45.0 - d) > sector + 1e-9) continue;
+        const double th = M_PI * i / t.n;
+        t.index.push_back(i);
+        t.cosQ.push_back(qRound64(std::cos(th) * (1 << kHoughShift)));
+        t.sinQ.push_back(qRound64(std::sin(th) * (1 << kHoughShift)));
+    }
+    return t;
+}
+
+// Воспроизводимая выборка: решение зависит только от координат точки (splitmix64)
+inline bool houghSampled(int x, int y, quint64 limit)
+{
+    quint64 z = (quint64(quint32(y)) << 32 | quint32(x)) + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return ((z ^ (z >> 31)) >> 32) < limit;
+}
+
+// Точки упакованной строки: пропуск пустых слов по 64 пикселя, биты — через ctz
+template<typename Fn>
+inline void forEachBit(const uchar* s, int w, Fn fn)
+{
+    const int bytes = (w + 7) / 8;
+    for (int i = 0; i < bytes; i += 8) {
+        quint64 v = 0;
+        std::memcpy(&v, s + i, size_t(std::min(8, bytes - i)));
+        v = qFromLittleEndian<quint64>(&v);
+        const int base = i * 8;
+        if (w - base < 64) v &= (quint64(1) << (w - base)) - 1;
+        while (v) {
+            fn(base + int(qCountTrailingZeroBits(v)));
+            v &= v - 1;
+        }
+    }
+}
+
+// Самый длинный отрезок маски вдоль прямой (ρ, θ): шаг в 1 пиксель по оси, вдоль
+// которой прямая длиннее, точка засчитывается в полосе ±1 пиксель поперёк
+// (ρ и θ квантованы), разрывы до maxGap шагов отрезок не делят.
+bool houghSegment(const QImage& bits, double rho, double theta, int maxGap, QPointF& p1, QPointF& p2)
+{
+    const int w = bits.width(), h = bits.height();
+    const double c = std::cos(theta), s = std::sin(theta);
+    const bool alongX = std::abs(s) >= std::abs(c);
+    const int len = alongX ? w : h;
+    auto at = [&](int t) { return alongX ? (rho - t * c) / s : (rho - t * s) / c; };
+    auto hit = [&](int t) {
+        const int m = qRound(at(t));
+        for (int d = -1; d <= 1; ++d) {
+            const int x = alongX ? t : m + d, y = alongX ? m + d : t;
+            if (x >= 0 && x < w && y >= 0 && y < h && (bits.constScanLine(y)[x >> 3] >> (x & 7) & 1)) return true;
+        }
+        return false;
+    };
+
+    int bestFirst = -1, bestLast = -1, first = -1, last = -1;
+    for (int t = 0; t < len; ++t) {
+        if (!hit(t)) continue;
+        if (first < 0 || t - last > maxGap + 1) first = t;
+        last = t;
+        if (last - first > bestLast - bestFirst) { bestFirst = first; bestLast = last; }
+    }
+    if (bestFirst < 0) return false;
+    p1 = alongX ? QPointF(bestFirst, at(bestFirst)) : QPointF(at(bestFirst), bestFirst);
+    p2 = alongX ? QPointF(bestLast, at(bestLast)) : QPointF(at(bestLast), bestLast);
+    return true;
+}
+
+struct HoughPeak {
+    quint32 votes;
+    int a, r;   // активный угол и номер ρ
+};
+
+} // namespace
+
+std::vector<HoughLine> houghLines(const QImage& mask, const HoughParams& params)
+{
+    if (mask.isNull()) return {};
+    const QImage bits = mask.format() == QImage::Format_Grayscale16
+        ? thresholdResponse(mask, params.response, MaskFormat::Mono) : packMask(mask);
+    const int w = bits.width(), h = bits.height();
+    const HoughAngles angles = houghAngles(params.thetaStep, params.sector);
+    const int na = int(angles.index.size());
+    if (na == 0) return {};
+
+    // Плотная маска — голосует выборка около denseFraction·w·h точек
+    const qint64 total = Parallel::reduce(0, h, Parallel::rowsPerBand(w), qint64(0), [&](int yb, int ye) {
+        qint64 n = 0;
+        for (int y = yb; y < ye; ++y) forEachBit(bits.constScanLine(y), w, [&n](int) { ++n; });
+        return n;
+    }, [](qint64& acc, qint64 part) { acc += part; });
+    if (total == 0) return {};
+    const double dense = std::max(1.0, params.denseFraction * w * h);
+    const double rate = total > dense ? dense / total : 1.0;
+    const quint64 limit = quint64(rate * 4294967296.0);
+
+    std::vector<HoughPoint> points = Parallel::reduce(0, h, Parallel::rowsPerBand(w), std::vector<HoughPoint>(),
+        [&](int yb, int ye) {
+            std::vector<HoughPoint> part;
+            for (int y = yb; y < ye; ++y)
+                forEachBit(bits.constScanLine(y), w, [&](int x) {
+                    if (rate == 1.0 || houghSampled(x, y, limit)) part.push_back({ x, y });
+                });
+            return part;
+        },
+        [](std::vector<HoughPoint>& acc, std::vector<HoughPoint>& part) { acc.insert(acc.end(), part.begin(), part.end()); });
+    if (points.empty()) return {};
+
+    // ρ от -rhoMax до rhoMax с шагом в пиксель; ячейка [a][r]
+    const int rhoMax = int(std::ceil(std::hypot(w, h)));
+    const int nRho = 2 * rhoMax + 1;
+    const size_t cells = size_t(na) * nRho;
+    const qint64 rhoOffset = (qint64(rhoMax) << kHoughShift) + (qint64(1) << (kHoughShift - 1));
+
+    // Аккумулятор на поток: части по числу потоков, но каждая не меньше нескольких
+    // строк ρ точек, чтобы сложение аккумуляторов не стоило дороже голосования
+    const int n = int(points.size());
+    const int minPart = std::max((n + threadCount() - 1) / threadCount(), 4 * nRho);
+    const std::vector<quint32> acc = Parallel::reduce(0, n, minPart, std::vector<quint32>(),
+        [&](int p0, int p1) {
+            std::vector<quint32> part(cells, 0);
+            for (int b = p0; b < p1; b += kHoughBlock) {
+                const int be = std::min(p1, b + kHoughBlock);
+                for (int a = 0; a < na; ++a) {
+                    quint32* row = part.data() + size_t(a) * nRho;
+                    const qint64 c = angles.cosQ[size_t(a)], s = angles.sinQ[size_t(a)];
+                    for (int p = b; p < be; ++p)
+                        ++row[(points[size_t(p)].x * c + points[size_t(p)].y * s + rhoOffset) >> kHoughShift];
+                }
+            }
+            return part;
+        },
+        [](std::vector<quint32>& sum, std::vector<quint32>& part) {
+            if (sum.empty()) { sum.swap(part); return; }
+            for (size_t i = 0; i < sum.size(); ++i) sum[i] += part[i];
+        });
+    if (acc.empty()) return {};   // отмена
+
+    // Пики: ячейка не меньше порога и сильнее соседей 3x3 (при равенстве — раньше их
+    // по номеру ячейки). Соседний угол — только смежный; за θ = π следует θ = 0 с ρ -> -ρ
+    const quint32 minVotes = quint32(std::max(1.0, std::ceil(std::max(1, params.minVotes) * rate)));
+    auto neighbourAngle = [&](int a, int da, bool& mirrored) {
+        const int b = a + da;
+        mirrored = false;
+        if (b >= 0 && b < na) return angles.index[size_t(b)] == angles.index[size_t(a)] + da ? b : -1;
+        const int wrapped = da > 0 ? 0 : na - 1;
+        const int expect = da > 0 ? angles.n - 1 : 0;
+        if (angles.index[size_t(a)] != expect || angles.index[size_t(wrapped)] != (da > 0 ? 0 : angles.n - 1)) return -1;
+        mirrored = true;
+        return wrapped;
+    };
+    std::vector<HoughPeak> peaks = Parallel::reduce(0, na, 1, std::vector<HoughPeak>(),
+        [&](int a0, int a1) {
+            std::vector<HoughPeak> part;
+            for (int a = a0; a < a1; ++a) {
+                const quint32* row = acc.data() + size_t(a) * nRho;
+                for (int r = 0; r < nRho; ++r) {
+                    const quint32 v = row[r];
+                    if (v < minVotes) continue;
+                    const size_t key = size_t(a) * nRho + r;
+                    bool peak = true;
+                    for (int da = -1; da <= 1 && peak; ++da) {
+                        bool mirrored = false;
+                        const int b = da == 0 ? a : neighbourAngle(a, da, mirrored);
+                        if (b < 0) continue;
+                        for (int dr = -1; dr <= 1 && peak; ++dr) {
+                            if (da == 0 && dr == 0) continue;
+                            const int q = mirrored ? nRho - 1 - (r + dr) : r + dr;
+                            if (q < 0 || q >= nRho) continue;
+                            const size_t other = size_t(b) * nRho + q;
+                            peak = !(acc[other] > v || (acc[other] == v && other < key));
+                        }
+                    }
+                    if (peak) part.push_back({ v, a, r });
+                }
+            }
+            return part;
+        },
+        [](std::vector<HoughPeak>& all, std::vector<HoughPeak>& part) { all.insert(all.end(), part.begin(), part.end()); });
+    std::sort(peaks.begin(), peaks.end(), [](const HoughPeak& l, const HoughPeak& r) {
+        return l.votes != r.votes ? l.votes > r.votes : (l.a != r.a ? l.a < r.a : l.r < r.r);
+    });
+
+    // Отрезки сильнейших пиков — пачками параллельно. Отрезок короче minLength или
+    // лежащий на уже принятом (оба конца в паре пикселей от него — «двойник» сильной
+    // прямой в соседних ячейках аккумулятора) отбрасывается
+    std::vector<HoughLine> lines;
+    const int maxLines = std::max(0, params.maxLines);
+    auto onSegment = [](const QPointF& p, const HoughLine& l) {
+        const double dx = l.p2.x() - l.p1.x(), dy = l.p2.y() - l.p1.y();
+        const double len2 = dx * dx + dy * dy;
+        const double t = len2 > 0 ? std::clamp(((p.x() - l.p1.x()) * dx + (p.y() - l.p1.y()) * dy) / len2, 0.0, 1.0) : 0.0;
+        return std::hypot(p.x() - l.p1.x() - t * dx, p.y() - l.p1.y() - t * dy) <= 2.5;
+    };
+    for (size_t first = 0; first < peaks.size() && int(lines.size()) < maxLines; first += size_t(maxLines)) {
+        const int count = int(std::min(peaks.size() - first, size_t(maxLines)));
+        std::vector<HoughLine> batch(count);
+        std::vector<char> found(size_t(count), 0);
+        Parallel::forRange(0, count, 1, [&](int i0, int i1) {
+            for (int i = i0; i < i1; ++i) {
+                const HoughPeak& pk = peaks[first + size_t(i)];
+                HoughLine& line = batch[size_t(i)];
+                line.rho = pk.r - rhoMax;
+                line.theta = angles.theta(pk.a);
+                line.votes = qRound(pk.votes / rate);
+                found[size_t(i)] = houghSegment(bits, line.rho, line.theta, std::max(0, params.maxGap), line.p1, line.p2);
+            }
+        });
+        for (int i = 0; i < count && int(lines.size()) < maxLines; ++i) {
+            const HoughLine& line = batch[size_t(i)];
+            if (!found[size_t(i)] || std::hypot(line.p2.x() - line.p1.x(), line.p2.y() - line.p1.y()) + 1 < params.minLength)
+                continue;
+            if (std::any_of(lines.begin(), lines.end(), [&](const HoughLine& o) {
+                    return onSegment(line.p1, o) && onSegment(line.p2, o); }))
+                continue;
+            lines.push_back(line);
+        }
+    }
+    return lines;
+}
+
 // ---------------- Адаптивная пороговая обработка (α-метод) ----------------
 
-QImage adaptiveAlpha(const QImage& gray, int windowSize, double alpha)
+QImage adaptiveAlpha(const QImage& gray, int windowSize, double alpha, MaskFormat format)
 {
     const int w = gray.width();
     const int h = gray.height();
@@ -260,61 +1865,342 @@ QImage adaptiveAlpha(const QImage& gray, int windowSize, double alpha)
     if ((windowSize & 1) == 0) ++windowSize;
     const int K = windowSize/2;
 
-    // Интегральное изображение для быстрого локального среднего
-    std::vector<uint32_t> ii;
-    integralImageU8(gray, ii);
+    // Локальные минимумы/максимумы за O(1) на пиксель при любом размере окна
+    std::vector<uchar> fminMap, fmaxMap;
+    localMinMax(gray, K, fminMap, fmaxMap);
 
-    QImage out(w, h, QImage::Format_Grayscale8);
+    QImage out = makeMask(w, h, format);
+    const RowWriter dstRow(out);
+    const bool packed = isPacked(out);
 
-    for (int y=0; y<h; ++y) {
-        const uchar* src = rowPtr(gray, y);
-        uchar* dst = rowPtr(out, y);
+    auto binarize = [&](const auto& sums) {
+        Parallel::forRange(0, h, Parallel::rowsPerBand(w), [&](int yb, int ye) {
+            std::vector<uchar> scratch(packed ? w : 0);
+            for (int y=yb; y<ye; ++y) {
+                const uchar* src = rowPtr(gray, y);
+                const uchar* mn = &fminMap[size_t(y)*w];
+                const uchar* mx = &fmaxMap[size_t(y)*w];
+                uchar* dst = packed ? scratch.data() : dstRow(y);
 
-        for (int x=0; x<w; ++x) {
-            // 1) локальная область (обрезка по границам, не reflect)
-            const int x0 = std::max(0, x - K);
-            const int x1 = std::min(w - 1, x + K);
-            const int y0 = std::max(0, y - K);
-            const int y1 = std::min(h - 1, y + K);
-
-            const int rx0 = x0, ry0 = y0, rx1 = x1 + 1, ry1 = y1 + 1;
-            const int count = (x1 - x0 + 1) * (y1 - y0 + 1);
-            const double mean = double(rectSum(ii, w, rx0, ry0, rx1, ry1)) / double(count);
-
-            // 2) локальные fmin/fmax (пробегаем окно — достаточно быстро для учебной задачи)
-            int fmin = 255, fmax = 0;
-            for (int yy=y0; yy<=y1; ++yy) {
-                const uchar* p = rowPtr(gray, yy);
-                for (int xx=x0; xx<=x1; ++xx) {
-                    const int v = p[xx];
-                    if (v < fmin) fmin = v;
-                    if (v > fmax) fmax = v;
+                for (int x=0; x<w; ++x) {
+                    // 1) локальная область (обрезка по границам, не reflect)
+                    const int x0 = std::max(0, x - K);
+                    const int x1 = std::min(w - 1, x + K);
+                    const int y0 = std::max(0, y - K);
+                    const int y1 = std::min(h - 1, y + K);
+
+                    const int rx0 = x0, ry0 = y0, rx1 = x1 + 1, ry1 = y1 + 1;
+                    const int count = (x1 - x0 + 1) * (y1 - y0 + 1);
+                    const double mean = double(sums.rectSum(rx0, ry0, rx1, ry1)) / double(count);
+
+                    // 2) локальные fmin/fmax — из заранее посчитанных карт
+                    dst[x] = alphaPixel(src[x], mean, mn[x], mx[x], alpha);
                 }
+                if (packed) packRow(dst, dstRow(y), w);
             }
+        });
+    };
 
-            const double dFmax = std::abs(fmax - mean);
-            const double dFmin = std::abs(fmin - mean);
-
-            // 3) выбор порога t по лекционной логике
-            double t = 0.0;
-            if (fmax == fmin) {
-                t = alpha * mean;
-            } else if (std::abs(dFmax - dFmin) < 1e-9) {
-                // равновесие — берём α*mean
-                t = alpha * mean;
-            } else if (dFmax > dFmin) {
-                t = alpha * ( (2.0/3.0)*fmin + (1.0/3.0)*mean );
-            } else {
-                t = alpha * ( (1.0/3.0)*fmin + (2.0/3.0)*mean );
-            }
+    // Локальное среднее — по интегральному изображению; для окон до 4096x4096
+    // хватает 32-битной таблицы при любом размере изображения
+    const qint64 area = qint64(std::min(windowSize, w)) * std::min(windowSize, h);
+    if (SumTable::fitsArea(area)) binarize(SumTable(gray));
+    else                          binarize(IntegralImage<quint64>(gray));
+    return out;
+}
 
-            // 4) сравнение |f - Ĥ| > t, где Ĥ ≡ mean
-            const double Hxy = mean;
-            dst[x] = (std::abs(int(src[x]) - Hxy) > t) ? 255 : 0;
+// ---------------- Локальные статистики: Ниблэк, Саувола, Вульф, Брэдли ----------------
+
+namespace {
+
+// Среднее и стандартное отклонение окон с центрами в строке y (окно обрезается
+// по краям): fn(x, mean, sd). Без таблицы квадратов sd = 0.
+template<class Sums, class SqSums, class Fn>
+inline void windowStatsRow(int y, int w, int h, int K, const Sums& sums, const SqSums* sq, Fn&& fn)
+{
+    const int y0 = std::max(0, y - K), y1 = std::min(h, y + K + 1);
+    for (int x=0; x<w; ++x) {
+        const int x0 = std::max(0, x - K), x1 = std::min(w, x + K + 1);
+        const double inv = 1.0 / (double(x1 - x0) * double(y1 - y0));
+        const double mean = double(sums.rectSum(x0, y0, x1, y1)) * inv;
+        double sd = 0.0;
+        if (sq) {
+            const double var = double(sq->rectSum(x0, y0, x1, y1)) * inv - mean * mean;
+            sd = var > 0.0 ? std::sqrt(var) : 0.0;
         }
+        fn(x, mean, sd);
+    }
+}
+
+// Sums/SqSums — типы таблиц, в которые точно помещаются суммы окна
+template<class Sums, class SqSums>
+QImage binarizeLocal(const QImage& gray, LocalMethod method, int K, double k, MaskFormat format)
+{
+    const int w = gray.width(), h = gray.height();
+    const Sums sums(gray);
+    std::unique_ptr<SqSums> sq;
+    if (method != LocalMethod::Bradley) sq.reset(new SqSums(gray));
+
+    // Вульф нормирует по всему изображению: минимум яркости M и наибольшее отклонение R
+    struct Range { int minVal = 255; double maxSd = 0.0; };
+    Range range;
+    if (method == LocalMethod::Wolf) {
+        range = Parallel::reduce(0, h, Parallel::rowsPerBand(w), Range(), [&](int yb, int ye) {
+            Range part;
+            for (int y=yb; y<ye; ++y) {
+                const uchar* s = rowPtr(gray, y);
+                part.minVal = std::min<int>(part.minVal, *std::min_element(s, s + w));
+                windowStatsRow(y, w, h, K, sums, sq.get(), [&](int, double, double sd) {
+                    part.maxSd = std::max(part.maxSd, sd);
+                });
+            }
+            return part;
+        }, [](Range& acc, const Range& part) {
+            acc.minVal = std::min(acc.minVal, part.minVal);
+            acc.maxSd = std::max(acc.maxSd, part.maxSd);
+        });
     }
+    const double M = range.minVal;
+    const double R = method == LocalMethod::Wolf ? std::max(range.maxSd, 1e-9) : 128.0;
 
+    QImage out = makeMask(w, h, format);
+    const RowWriter dstRow(out);
+    const bool packed = isPacked(out);
+    Parallel::forRange(0, h, Parallel::rowsPerBand(w), [&](int yb, int ye) {
+        std::vector<uchar> scratch(packed ? w : 0);
+        for (int y=yb; y<ye; ++y) {
+            const uchar* src = rowPtr(gray, y);
+            uchar* dst = packed ? scratch.data() : dstRow(y);
+            windowStatsRow(y, w, h, K, sums, sq.get(), [&](int x, double m, double sd) {
+                double t = 0.0;
+                switch (method) {
+                case LocalMethod::Niblack: t = m + k * sd; break;
+                case LocalMethod::Sauvola: t = m * (1.0 + k * (sd / R - 1.0)); break;
+                case LocalMethod::Wolf:    t = m - k * (1.0 - sd / R) * (m - M); break;
+                case LocalMethod::Bradley: t = m * (1.0 - k); break;
+                }
+                dst[x] = (src[x] > t) ? 255 : 0;
+            });
+            if (packed) packRow(dst, dstRow(y), w);
+        }
+    });
     return out;
 }
 
+} // namespace
+
+QImage thresholdLocal(const QImage& gray, LocalMethod method, int windowSize, double k, MaskFormat format)
+{
+    const int w = gray.width(), h = gray.height();
+    if (w==0 || h==0) return QImage();
+    if (windowSize < 3) windowSize = 3;
+    if ((windowSize & 1) == 0) ++windowSize;
+    const int K = windowSize/2;
+
+    // Самые узкие таблицы, в которых суммы окна точны: 32 бита для квадратов
+    // хватает до окна 257x257, для значений — до 4096x4096
+    const qint64 area = qint64(std::min(windowSize, w)) * std::min(windowSize, h);
+    if (IntegralImage<quint32, true>::fitsArea(area))
+        return binarizeLocal<SumTable, IntegralImage<quint32, true>>(gray, method, K, k, format);
+    if (SumTable::fitsArea(area))
+        return binarizeLocal<SumTable, SqSumTable>(gray, method, K, k, format);
+    return binarizeLocal<IntegralImage<quint64>, SqSumTable>(gray, method, K, k, format);
+}
+
+double localDefaultK(LocalMethod method)
+{
+    switch (method) {
+    case LocalMethod::Niblack: return -0.2;
+    case LocalMethod::Sauvola: return 0.34;
+    case LocalMethod::Wolf:    return 0.5;
+    case LocalMethod::Bradley: return 0.15;
+    }
+    return 0.0;
+}
+
+// ---------------- Построчный α-метод ----------------
+//
+// Вертикальная последовательность — горизонтальные min/max строк, дополненные
+// K нейтральными элементами сверху и снизу, как в localMinMax. Элемент i
+// (строка i-K) дописывается в блок длины N; когда блок заполнен, считаются
+// его суффиксные экстремумы, и окно строки y = i-N+1 — это
+// min(суффикс[y], префикс текущего блока). Суффиксы блока нужны только до конца
+// следующего блока, поэтому хватает двух буферов по N строк.
+
+namespace {
+const int kColumnsPerTask = 8192;   // построчные проходы делятся между потоками по столбцам
+}
+
+AlphaStream::AlphaStream(int width, int height, int windowSize, double alpha)
+    : w_(width), h_(height), alpha_(alpha)
+{
+    if (windowSize < 3) windowSize = 3;
+    if ((windowSize & 1) == 0) ++windowSize;
+    K_ = windowSize / 2;
+    N_ = windowSize;
+
+    const size_t block = size_t(N_) * w_;
+    raw_.resize(block);
+    blockMin_.resize(block); blockMax_.resize(block);
+    sufMin_.resize(block);   sufMax_.resize(block);
+    colSum_.assign(w_, 0);
+    prefix_.resize(size_t(w_) + 1);
+    preMin_.resize(w_); preMax_.resize(w_);
+    out_.resize(w_);
+
+    // верхний край: K нейтральных элементов (строк результата они ещё не дают)
+    const std::vector<uchar> lo(w_, 255), hi(w_, 0);
+    for (int i=0; i<K_; ++i) feed(lo.data(), hi.data(), Emit());
+}
+
+void AlphaStream::push(const uchar* src, qsizetype bpl, int rows, const Emit& emit)
+{
+    rows = std::min(rows, h_ - rowsIn_);
+    if (rows <= 0 || w_ == 0) return;
+
+    // Горизонтальные min/max всей полосы — параллельно по строкам
+    rowMin_.resize(size_t(rows) * w_);
+    rowMax_.resize(size_t(rows) * w_);
+    Parallel::forRange(0, rows, Parallel::rowsPerBand(w_), [&](int rb, int re) {
+        std::vector<uchar> gMin, gMax, hMin, hMax;
+        for (int r=rb; r<re; ++r)
+            slidingMinMaxRow(src + bpl*r, w_, K_, &rowMin_[size_t(r)*w_], &rowMax_[size_t(r)*w_],
+                             gMin, gMax, hMin, hMax);
+    });
+
+    for (int r=0; r<rows; ++r) {
+        const uchar* row = src + bpl*r;
+        const int y = rowsIn_++;
+        // место строки y-N в кольце уже свободно: она вычтена из сумм после строки y-K-1
+        std::copy_n(row, w_, &raw_[size_t(y % N_) * w_]);
+        for (int x=0; x<w_; ++x) colSum_[x] += row[x];
+        feed(&rowMin_[size_t(r)*w_], &rowMax_[size_t(r)*w_], emit);
+    }
+
+    if (rowsIn_ == h_) {
+        // нижний край: нейтральные элементы, пока не выйдут все строки результата
+        const std::vector<uchar> lo(w_, 255), hi(w_, 0);
+        while (fed_ < h_ + N_ - 1) feed(lo.data(), hi.data(), emit);
+    }
+}
+
+void AlphaStream::feed(const uchar* rowMin, const uchar* rowMax, const Emit& emit)
+{
+    const int i = fed_++;
+    const int slot = i % N_;
+    std::copy_n(rowMin, w_, &blockMin_[size_t(slot) * w_]);
+    std::copy_n(rowMax, w_, &blockMax_[size_t(slot) * w_]);
+
+    if (slot == 0) {
+        std::copy_n(rowMin, w_, preMin_.data());
+        std::copy_n(rowMax, w_, preMax_.data());
+    } else {
+        for (int x=0; x<w_; ++x) {
+            preMin_[x] = std::min(preMin_[x], rowMin[x]);
+            preMax_[x] = std::max(preMax_[x], rowMax[x]);
+        }
+    }
+
+    if (slot == N_ - 1) {
+        // Блок заполнен — его суффиксные экстремумы, снизу вверх
+        Parallel::forRange(0, w_, kColumnsPerTask, [&](int c0, int c1) {
+            for (int s=N_-1; s>=0; --s) {
+                const uchar* bn = &blockMin_[size_t(s) * w_];
+                const uchar* bx = &blockMax_[size_t(s) * w_];
+                uchar* sn = &sufMin_[size_t(s) * w_];
+                uchar* sx = &sufMax_[size_t(s) * w_];
+                if (s == N_ - 1) {
+                    std::copy(bn + c0, bn + c1, sn + c0);
+                    std::copy(bx + c0, bx + c1, sx + c0);
+                } else {
+                    for (int c=c0; c<c1; ++c) {
+                        sn[c] = std::min(sn[c + w_], bn[c]);
+                        sx[c] = std::max(sx[c + w_], bx[c]);
+                    }
+                }
+            }
+        });
+    }
+
+    const int y = i - (N_ - 1);
+    if (y >= 0 && y < h_) emitRow(y, emit);
+}
+
+void AlphaStream::emitRow(int y, const Emit& emit)
+{
+    const int K = K_;
+    const int y0 = std::max(0, y - K);
+    const int y1 = std::min(h_ - 1, y + K);
+    const int rowsInWindow = y1 - y0 + 1;
+
+    // Столбцовые суммы покрывают строки y0..y1: горизонтальное окно — разность префиксов
+    prefix_[0] = 0;
+    for (int x=0; x<w_; ++x) prefix_[x+1] = prefix_[x] + colSum_[x];
+
+    const uchar* f  = &raw_[size_t(y % N_) * w_];
+    const uchar* sn = &sufMin_[size_t(y % N_) * w_];
+    const uchar* sx = &sufMax_[size_t(y % N_) * w_];
+    Parallel::forRange(0, w_, kColumnsPerTask, [&](int c0, int c1) {
+        for (int x=c0; x<c1; ++x) {
+            const int x0 = std::max(0, x - K);
+            const int x1 = std::min(w_ - 1, x + K);
+            const int count = (x1 - x0 + 1) * rowsInWindow;
+            const double mean = double(prefix_[x1 + 1] - prefix_[x0]) / double(count);
+            out_[x] = alphaPixel(f[x], mean, std::min(sn[x], preMin_[x]), std::max(sx[x], preMax_[x]), alpha_);
+        }
+    });
+    if (emit) emit(y, out_.data());
+
+    // строка y-K выходит из окна следующей строки
+    if (y - K >= 0) {
+        const uchar* old = &raw_[size_t((y - K) % N_) * w_];
+        for (int x=0; x<w_; ++x) colSum_[x] -= old[x];
+    }
+}
+
+// ---------------- Область интереса и масштаб ----------------
+
+QImage resizeGray(const QImage& gray, const QSize& size)
+{
+    if (gray.isNull() || size.isEmpty()) return QImage();
+    QImage img = gray;
+    // уровни 2x2 — пока следующий уровень не меньше нужного размера
+    while (img.width() / 2 >= size.width() && img.height() / 2 >= size.height())
+        img = downsample2x(img);
+    if (img.size() == size) return img;
+    // smoothScaled не умеет Grayscale8 напрямую и возвращает 32-битный формат
+    return toGrayscale(img.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+}
+
+QImage processRegion(const QImage& gray, const QRect& roi, double scale, const RegionOp& op)
+{
+    const QRect r = roi.intersected(gray.rect());
+    if (r.isEmpty() || !op.run || !(scale > 0.0)) return QImage();
+    scale = std::min(scale, 1.0);
+
+    // Ореол в пикселях исходника; при уменьшении — с запасом на сглаживание
+    const int halo = std::max(0, op.halo);
+    const int haloSrc = scale < 1.0 ? int(std::ceil((halo + 1) / scale)) : halo;
+    const QRect crop = r.adjusted(-haloSrc, -haloSrc, haloSrc, haloSrc).intersected(gray.rect());
+
+    QImage src = gray.copy(crop);
+    if (scale < 1.0) {
+        const QSize scaled(std::max(1, int(std::lround(crop.width()  * scale))),
+                           std::max(1, int(std::lround(crop.height() * scale))));
+        src = resizeGray(src, scaled);
+    }
+
+    const QImage res = op.run(src);
+    if (res.isNull()) return QImage();
+
+    // Вырезаем roi обратно, в координатах рабочего масштаба
+    const double sx = double(res.width())  / crop.width();
+    const double sy = double(res.height()) / crop.height();
+    const int x0 = int(std::lround((r.x() - crop.x()) * sx));
+    const int y0 = int(std::lround((r.y() - crop.y()) * sy));
+    const int rw = std::max(1, int(std::lround(r.width()  * sx)));
+    const int rh = std::max(1, int(std::lround(r.height() * sy)));
+    return res.copy(QRect(x0, y0, rw, rh).intersected(res.rect()));
+}
+
 } // namespace Img
@@ -1,37 +1,343 @@
 #pragma once
 
 #include <QImage>
+#include <QPointF>
+#include <QRect>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <vector>
 
 namespace Img
 {
+// ---------------- ПАРАЛЛЕЛЬНОЕ ВЫПОЛНЕНИЕ ----------------
+
+// Число потоков для всех операций Img (0 — по числу ядер процессора).
+// Результат не зависит от числа потоков: полосы пишут непересекающиеся строки.
+void setThreadCount(int n);
+int threadCount();
+
+// Статистика параллельных проходов, накопленная в текущем потоке с момента resetParallelStats()
+struct ParallelStats {
+    int    threads = 0;       // максимум одновременно работавших потоков
+    int    passes = 0;        // число параллельных проходов
+    int    tasks = 0;         // число полос (задач)
+    double wallMs = 0.0;      // время проходов по часам
+    double busyMs = 0.0;      // суммарное время полезной работы всех потоков
+    double capacityMs = 0.0;  // Σ (время прохода × число потоков)
+
+    double speedup() const;     // busy / wall — во сколько раз быстрее одного потока
+    double efficiency() const;  // busy / capacity — эффективность масштабирования (0..1)
+};
+void resetParallelStats();
+ParallelStats parallelStats();
+
+// ---------------- ОТМЕНА И ПРОГРЕСС ----------------
+
+// Управление операцией, запущенной в фоновом потоке. Перед каждой полосой
+// параллельный проход проверяет флаг отмены: после cancel() оставшиеся полосы
+// пропускаются и операция быстро возвращает недосчитанный результат, который
+// вызывающий код должен отбросить. Счётчики прогресса можно читать из любого потока.
+struct TaskControl {
+    std::atomic<bool> cancelled{false};
+    std::atomic<int>  passes{0};   // начато параллельных проходов
+    std::atomic<int>  done{0};     // выполнено полос текущего прохода
+    std::atomic<int>  total{0};    // полос в текущем проходе
+
+    void cancel() { cancelled = true; }
+    bool isCancelled() const { return cancelled.load(); }
+    double passProgress() const;   // доля выполненных полос текущего прохода (0..1)
+};
+
+// Привязать TaskControl к текущему потоку (nullptr — отвязать): его используют
+// все операции Img, запущенные из этого потока
+void setTaskControl(TaskControl* control);
+TaskControl* taskControl();
+
 // Преобразование изображения в оттенки серого (8 бит на пиксель)
 QImage toGrayscale(const QImage& src);
 
+// Уменьшение вдвое по каждой оси усреднением блоков 2x2 (уровень пирамиды превью).
+// Размер результата — ((w+1)/2, (h+1)/2), нечётный край дублируется.
+// Упакованная маска (Format_MonoLSB) тоже принимается, результат — Grayscale8.
+QImage downsample2x(const QImage& gray);
+
+// ---------------- ДВОИЧНЫЕ МАСКИ ----------------
+// Пороговые операции возвращают маску в одном из двух форматов:
+//   Gray8 — Format_Grayscale8, 255/0 (по умолчанию);
+//   Mono  — Format_MonoLSB, 1 бит на пиксель (бит x%8 байта x/8, 1 — белый,
+//           таблица цветов {чёрный, белый}): в 8 раз меньше памяти.
+// Упакованную маску операции пишут сразу, по 8 пикселей за шаг, без
+// промежуточного 8-битного изображения. Qt показывает и сохраняет её как есть,
+// toGrayscale() разворачивает обратно в 255/0.
+enum class MaskFormat { Gray8, Mono };
+
+// Упаковка серой маски в Format_MonoLSB: яркость >= 128 — белый
+QImage packMask(const QImage& gray);
+
 // ---------------- ГЛОБАЛЬНЫЕ ПОРОГОВЫЕ МЕТОДЫ ----------------
 
+// Статистика яркости: гистограмма, накопленные суммы и среднее.
+// Считается одним параллельным проходом; все глобальные методы работают только
+// с ней, поэтому её стоит держать в кэше для каждого загруженного изображения.
+struct ImageStats {
+    std::array<qint64, 256> hist{};      // число пикселей яркости i
+    std::array<qint64, 256> cumCount{};  // Σ hist[0..i]
+    std::array<qint64, 256> cumSum{};    // Σ j·hist[j], j ≤ i
+    qint64 total = 0;                    // число пикселей
+    double mean = 0.0;                   // средняя яркость
+
+    bool isEmpty() const { return total == 0; }
+
+    static ImageStats compute(const QImage& gray);
+    // Накопленные суммы и среднее по готовой гистограмме (например, сложенной по полосам)
+    static ImageStats fromHistogram(const std::array<qint64, 256>& hist);
+
+    int otsuThreshold() const;        // порог Отсу
+    double isodataThreshold() const;  // порог ISODATA
+};
+
 // Метод Отсу (автоматический выбор порога)
-QImage thresholdOtsu(const QImage& gray);
+QImage thresholdOtsu(const QImage& gray, MaskFormat format = MaskFormat::Gray8);
+QImage thresholdOtsu(const QImage& gray, const ImageStats& stats, MaskFormat format = MaskFormat::Gray8);
 
 // Итеративный метод (ISODATA)
-QImage thresholdIterative(const QImage& gray);
+QImage thresholdIterative(const QImage& gray, MaskFormat format = MaskFormat::Gray8);
+QImage thresholdIterative(const QImage& gray, const ImageStats& stats, MaskFormat format = MaskFormat::Gray8);
 
-QImage thresholdMean(const QImage& gray);
+QImage thresholdMean(const QImage& gray, MaskFormat format = MaskFormat::Gray8);
+QImage thresholdMean(const QImage& gray, const ImageStats& stats, MaskFormat format = MaskFormat::Gray8);
 
 //-----------------АДАПТИВНАЯ ПОРОГОВАЯ ОБРАБОТКА-------------
 // α-метод по лекции: порог t = α * φ(local min/max/mean) и сравнение |f - Ĥ| > t,
 // где Ĥ — локальная оценка (используем локальное среднее).
-QImage adaptiveAlpha(const QImage& gray, int windowSize, double alpha);
+QImage adaptiveAlpha(const QImage& gray, int windowSize, double alpha, MaskFormat format = MaskFormat::Gray8);
+
+// Тот же α-метод для изображения, которое подаётся строками сверху вниз
+// (потоковая обработка, stream.h). Хранится только окно: N = windowSize
+// исходных строк, столбцовые суммы для локального среднего и два блока по N
+// строк для вертикального van Herk — память O(N·w) при любой высоте.
+// Результат совпадает с adaptiveAlpha (маска 255/0).
+class AlphaStream {
+public:
+    using Emit = std::function<void(int y, const uchar* row)>;
+
+    AlphaStream(int width, int height, int windowSize, double alpha);
+
+    // Следующие rows строк изображения (шаг bpl). Готовые строки результата
+    // уходят в emit по порядку, с задержкой в полокна; после последней строки
+    // изображения выдаются все оставшиеся.
+    void push(const uchar* src, qsizetype bpl, int rows, const Emit& emit);
+
+private:
+    void feed(const uchar* rowMin, const uchar* rowMax, const Emit& emit);
+    void emitRow(int y, const Emit& emit);
+
+    int w_, h_, K_, N_;
+    double alpha_;
+    int rowsIn_ = 0;     // принято строк изображения
+    int fed_ = 0;        // элементов вертикальной последовательности (с нейтральными краями)
+    std::vector<uchar> raw_;                    // кольцо из N исходных строк
+    std::vector<quint32> colSum_;               // суммы столбцов по строкам окна
+    std::vector<quint64> prefix_;               // префиксные суммы colSum_ для текущей строки
+    std::vector<uchar> blockMin_, blockMax_;    // горизонтальные min/max строк текущего блока
+    std::vector<uchar> sufMin_, sufMax_;        // суффиксные экстремумы последнего полного блока
+    std::vector<uchar> preMin_, preMax_;        // префиксные экстремумы текущего блока
+    std::vector<uchar> rowMin_, rowMax_;        // горизонтальные min/max принятой полосы
+    std::vector<uchar> out_;
+};
+
+// Пороги по локальным среднему m и стандартному отклонению s в окне N×N
+// (окно обрезается по краям, как в adaptiveAlpha). Пиксель белый, если f > T:
+//   Niblack  T = m + k·s                                  (k ≈ −0.2)
+//   Sauvola  T = m·(1 + k·(s/R − 1)), R = 128              (k ≈ 0.34)
+//   Wolf     T = m − k·(1 − s/R)·(m − M), M — минимум изображения,
+//            R — наибольшее s по изображению               (k ≈ 0.5)
+//   Bradley  T = m·(1 − k)                                 (k ≈ 0.15, Брэдли–Рот)
+// m и s берутся из интегральных изображений значений и квадратов (integral.h),
+// поэтому время на пиксель не зависит от размера окна.
+enum class LocalMethod { Niblack, Sauvola, Wolf, Bradley };
+
+QImage thresholdLocal(const QImage& gray, LocalMethod method, int windowSize, double k,
+                      MaskFormat format = MaskFormat::Gray8);
+
+// Типичное k метода (значения выше)
+double localDefaultK(LocalMethod method);
+
+// ---------------- СГЛАЖИВАНИЕ ----------------
+
+// Гауссово размытие рекурсивным фильтром Янга–ван Влита: проход вперёд и назад
+// третьего порядка по строкам, затем по столбцам. Время не зависит от sigma;
+// края продолжаются крайним значением. sigma < 0.5 — изображение без изменений.
+// Перед детекторами подавляет шум, который иначе раздувает отклики Собеля и Лапласа.
+QImage gaussianBlur(const QImage& gray, double sigma);
+
+// Радиус, за которым вклад гауссова ядра пренебрежим (ореол для processRegion)
+inline int gaussianRadius(double sigma) { return sigma < 0.5 ? 0 : int(std::ceil(3.0 * sigma)); }
+
+// Медианный фильтр в окне (2r+1)x(2r+1) с отражением краёв — против шума «соль и
+// перец», который не размывается, а убирается. Метод Перро–Эбера: гистограммы
+// столбцов обновляются по строке при сдвиге окна вниз, гистограмма окна — по
+// столбцу при сдвиге вправо, так что время на пиксель не растёт с радиусом.
+// radius <= 0 — изображение без изменений, больше kMaxMedianRadius — обрезается.
+constexpr int kMaxMedianRadius = 255;
+QImage medianFilter(const QImage& gray, int radius);
 
 // ---------------- СЕГМЕНТАЦИЯ ----------------
 
 // Перепады яркости (границы) — оператор Собеля, модуль градиента + порог
-QImage edgesSobel(const QImage& gray, int threshold);
+QImage edgesSobel(const QImage& gray, int threshold, MaskFormat format = MaskFormat::Gray8);
 
 // Обнаружение линий — направленные ядра (горизонтальные, вертикальные, диагональные),
 // берём максимум по модулям откликов и порог
-QImage linesKernels(const QImage& gray, int threshold);
+QImage linesKernels(const QImage& gray, int threshold, MaskFormat format = MaskFormat::Gray8);
 
 // Обнаружение точек — Лапласиан (по модулю) + порог
-QImage pointsLaplacian(const QImage& gray, int threshold);
+QImage pointsLaplacian(const QImage& gray, int threshold, MaskFormat format = MaskFormat::Gray8);
+
+// ---------------- СОВМЕЩЁННЫЙ ПРОХОД ДЕТЕКТОРОВ ----------------
+// Любое подмножество детекторов 3x3 плюс направление градиента за один проход:
+// окрестность каждого пикселя загружается один раз, результаты пишутся сразу в
+// несколько изображений. Маски совпадают с edgesSobel/linesKernels/pointsLaplacian.
+
+enum DetectorFlag {
+    DetectSobel     = 0x1,
+    DetectLines     = 0x2,
+    DetectPoints    = 0x4,
+    DetectDirection = 0x8,   // направление градиента Собеля
+};
+
+struct DetectorThresholds {
+    int sobel = 100;
+    int lines = 120;
+    int points = 150;
+};
+
+// Незапрошенные изображения остаются пустыми (isNull()).
+// direction: угол atan2(gy, gx), отображённый на 0..255 (256 = полный оборот), Grayscale8.
+struct Detections {
+    QImage sobel;
+    QImage lines;
+    QImage points;
+    QImage direction;
+};
+
+Detections detectFused(const QImage& gray, int which, const DetectorThresholds& th = {});
+
+// ---------------- КАРТЫ ОТКЛИКОВ ----------------
+// Те же детекторы без последнего сравнения с порогом: 16-битные карты (Format_Grayscale16).
+// Карту достаточно посчитать один раз на изображение, а смена порога —
+// это только проход thresholdResponse. Результат thresholdResponse(xxxResponse(g), T)
+// совпадает с соответствующим детектором.
+
+QImage sobelMagnitude(const QImage& gray);     // int(|∇|), не больше 1443
+QImage linesResponse(const QImage& gray);      // max |отклик| направленных ядер, не больше 1530
+QImage laplacianResponse(const QImage& gray);  // |Лаплас|, не больше 2040
+
+// Бинаризация карты откликов: 255 там, где отклик >= threshold
+QImage thresholdResponse(const QImage& response, int threshold, MaskFormat format = MaskFormat::Gray8);
+
+// ---------------- ДЕТЕКТОР КАННИ ----------------
+// Модуль градиента Собеля (sobelMagnitude, в его шкале и пороги), подавление
+// немаксимумов вдоль градиента (секторы 0°/45°/90°/135°) и двойной порог с
+// гистерезисом: слабые пиксели (low <= |∇| < high) остаются, если 8-связно
+// соединены с сильными (|∇| >= high). Связность — параллельный union-find по
+// полосам строк со слиянием на границах полос, без последовательной заливки.
+// После отмены (TaskControl) — пустое изображение.
+QImage edgesCanny(const QImage& gray, int low, int high, MaskFormat format = MaskFormat::Gray8);
+
+// ---------------- СВЯЗНЫЕ КОМПОНЕНТЫ ----------------
+// Разметка 8-связных областей маски и их статистика — этап после любой
+// бинаризации. Двухпроходный алгоритм по блокам 2x2 с union-find: первый проход
+// параллельно по полосам строк со слиянием на границах полос, второй нумерует
+// компоненты и собирает статистику.
+struct Component {
+    qint64 area = 0;        // пикселей
+    QRect bounds;           // описывающий прямоугольник
+    QPointF centroid;       // центр масс по координатам пикселей
+};
+struct Components {
+    std::vector<Component> list;    // компонента с меткой L — list[L - 1]; порядок — по первому блоку
+    std::vector<quint32> labels;    // метки пикселей построчно (0 — фон), если запрошены
+    int width = 0;
+    int height = 0;
+
+    int count() const { return int(list.size()); }
+};
+// mask — Grayscale8 (пиксель белый при яркости >= 128) или Format_MonoLSB.
+// white: компоненты из белых пикселей (отклики детекторов) или из чёрных
+// (текст после пороговых методов). withLabels — заполнить labels (4 байта на пиксель).
+// После отмены (TaskControl) — пустой результат.
+Components labelComponents(const QImage& mask, bool white = true, bool withLabels = false);
+
+// ---------------- МОРФОЛОГИЯ ДВОИЧНЫХ МАСОК ----------------
+// Эрозия/дилатация белых пикселей маски и их композиции: размыкание убирает
+// белые крапинки меньше элемента, замыкание — чёрные. Маска обрабатывается
+// упакованной, по 64 пикселя за операцию: по строкам окно собирается сдвигами
+// с удвоением (log2 ширины), по столбцам — van Herk (не зависит от высоты).
+enum class MorphOp { Erode, Dilate, Open, Close };
+enum class StructShape {
+    Rect,    // прямоугольник width x height
+    Cross    // крест: горизонтальный отрезок width и вертикальный height через центр
+};
+// mask — Grayscale8 (белый при яркости >= 128) или Format_MonoLSB, результат в том же
+// формате, так что этап ставится после любой бинаризации. Центр элемента — (width/2, height/2);
+// за краем изображения эрозия считает пиксели белыми, дилатация — чёрными.
+QImage morphology(const QImage& mask, MorphOp op, int width, int height,
+                  StructShape shape = StructShape::Rect);
+
+// ---------------- ПРЕОБРАЗОВАНИЕ ХАФА ----------------
+// Отрезки прямых по маске детектора (linesKernels, edgesSobel, edgesCanny) или по
+// карте откликов. Прямая — x·cos θ + y·sin θ = ρ (ось y вниз, θ — угол нормали).
+// Точки маски голосуют в аккумуляторы (ρ, θ), свои у каждого потока, которые
+// затем складываются; пики суммы — прямые, а на самой маске вдоль прямой ищется
+// самый длинный отрезок. cos/sin берутся из таблиц, и только для углов в секторах
+// вокруг направлений ядер 0°/45°/90°/135°. На плотной маске голосует случайная
+// (но воспроизводимая) выборка точек, а число голосов пересчитывается на все.
+struct HoughLine {
+    double rho = 0.0;       // пикселей от левого верхнего пикселя
+    double theta = 0.0;     // радианы, [0, π)
+    int votes = 0;          // голосов за прямую
+    QPointF p1, p2;         // концы отрезка
+};
+struct HoughParams {
+    int response = 120;             // порог карты откликов Grayscale16 (как у linesKernels)
+    double thetaStep = 0.5;         // шаг угла, градусы
+    double sector = 10.0;           // полуширина секторов вокруг 0°/45°/90°/135°; от 22.5 — все углы
+    int minVotes = 50;              // минимум голосов за прямую
+    int minLength = 30;             // минимальная длина отрезка, пикселей
+    int maxGap = 3;                 // разрыв, который ещё не делит отрезок
+    int maxLines = 100;             // не больше стольких самых сильных прямых
+    double denseFraction = 0.02;    // точек больше этой доли изображения — голосует выборка
+};
+// mask — Grayscale8 (точка при яркости >= 128), Format_MonoLSB или карта откликов
+// Grayscale16 (точка при отклике >= params.response). Прямые — по убыванию голосов.
+std::vector<HoughLine> houghLines(const QImage& mask, const HoughParams& params = {});
+
+// ---------------- ОБЛАСТЬ ИНТЕРЕСА И МАСШТАБ ----------------
+// Операция считается только для прямоугольника roi (координаты gray) и сразу
+// в масштабе scale (0 < scale <= 1), например для видимой части окна.
+// Вокруг roi захватывается «ореол» halo пикселей рабочего масштаба — радиус
+// окрестности операции, поэтому при scale = 1 результат внутри roi совпадает
+// с вырезкой из результата по всему изображению (на краях изображения
+// ореол обрезается — так же, как обрезает окрестность сама операция).
+// При scale < 1 область сначала уменьшается усреднением, результат —
+// операция над уменьшенной копией, как в превью.
+//   3x3-детекторы: halo = 1;  α-метод: halo = windowSize/2;
+//   глобальные методы: halo = 0, статистика — по всему изображению
+//   (ImageStats::compute(gray)), иначе порог будет зависеть от roi.
+struct RegionOp {
+    int halo = 0;
+    std::function<QImage(const QImage& gray)> run;
+};
+
+// Размер результата — roi, умноженный на scale (не меньше 1x1);
+// пустое пересечение roi с изображением — пустой QImage.
+QImage processRegion(const QImage& gray, const QRect& roi, double scale, const RegionOp& op);
+
+// Уменьшение до произвольного размера усреднением: сначала уровни downsample2x,
+// затем сглаживающее масштабирование последнего шага (Grayscale8)
+QImage resizeGray(const QImage& gray, const QSize& size);
 
 } // namespace Img
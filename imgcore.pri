@@ -0,0 +1,24 @@
+# Ядро обработки (namespace Img) без GUI — общее для приложения и утилит.
+# Подключается через include(); пути задаются относительно этого файла.
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/imageprocessor.cpp \
+    $$PWD/mappedio.cpp \
+    $$PWD/maskio.cpp \
+    $$PWD/parallel.cpp \
+    $$PWD/pipeline.cpp \
+    $$PWD/simdkernels.cpp \
+    $$PWD/stream.cpp
+
+HEADERS += \
+    $$PWD/imageprocessor.h \
+    $$PWD/integral.h \
+    $$PWD/mappedio.h \
+    $$PWD/maskio.h \
+    $$PWD/parallel.h \
+    $$PWD/pipeline.h \
+    $$PWD/simdkernels.h \
+    $$PWD/stencil.h \
+    $$PWD/stream.h
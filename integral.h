@@ -0,0 +1,128 @@
+#pragma once
+
+#include <QImage>
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include "imageprocessor.h"
+#include "parallel.h"
+
+// Интегральное изображение (summed-area table) 8-битного серого изображения:
+// сумма значений или их квадратов по любому прямоугольнику за четыре обращения,
+// то есть локальные среднее и дисперсия за O(1) на пиксель при любом окне.
+//
+// Таблица хранится по модулю 2^bits типа T. Беззнаковое переполнение префиксов
+// на больших изображениях результат не портит: разность в rectSum берётся по тому
+// же модулю и точна, пока сама сумма по прямоугольнику помещается в T
+// (fitsArea). Поэтому размер изображения не ограничен, а тип выбирается по окну:
+// суммам значений в окнах до 4096x4096 хватает uint32, квадратам — при окнах до
+// 257x257; для больших окон нужен uint64 (вдвое больше памяти).
+//
+// Построение — параллельный двухпроходный префиксный скан по полосам строк:
+//   1) каждая полоса независимо считает свою таблицу (суммы строк и накопление
+//      по столбцам от начала полосы);
+//   2) последние строки полос последовательно складываются в переносы,
+//      и каждая полоса добавляет перенос предыдущей ко всем своим строкам.
+namespace Img {
+
+template<typename T, bool Squares = false>
+class IntegralImage {
+    static_assert(std::is_unsigned<T>::value, "суммы по модулю — только беззнаковые типы");
+
+public:
+    IntegralImage() = default;
+    explicit IntegralImage(const QImage& gray) { build(gray); }
+
+    // gray — Grayscale8
+    void build(const QImage& gray);
+
+    bool isNull() const { return !data_; }
+    int width() const { return w_; }
+    int height() const { return h_; }
+
+    // Строка таблицы y (0..height): элемент x (0..width) — сумма по [0,x) x [0,y)
+    const T* row(int y) const { return data_.get() + size_t(y) * stride_; }
+
+    // Сумма по прямоугольнику [x0,x1) x [y0,y1)
+    T rectSum(int x0, int y0, int x1, int y1) const
+    {
+        const T* r0 = row(y0);
+        const T* r1 = row(y1);
+        return T(r1[x1] - r0[x1] - r1[x0] + r0[x0]);
+    }
+
+    // Сумма по прямоугольнику площади area точно помещается в T
+    static constexpr bool fitsArea(qint64 area)
+    {
+        return quint64(area) <= quint64(std::numeric_limits<T>::max()) / kMaxValue;
+    }
+
+private:
+    static constexpr quint64 kMaxValue = Squares ? 255u * 255u : 255u;
+
+    T* rowMut(int y) { return data_.get() + size_t(y) * stride_; }
+
+    std::unique_ptr<T[]> data_;   // без обнуления: проход 1 пишет каждый элемент
+    size_t stride_ = 0;
+    int w_ = 0;
+    int h_ = 0;
+};
+
+using SumTable   = IntegralImage<quint32>;
+using SqSumTable = IntegralImage<quint64, true>;
+
+template<typename T, bool Squares>
+void IntegralImage<T, Squares>::build(const QImage& gray)
+{
+    w_ = gray.width();
+    h_ = gray.height();
+    stride_ = size_t(w_) + 1;
+    data_.reset(new T[stride_ * (size_t(h_) + 1)]);
+    std::fill(rowMut(0), rowMut(0) + stride_, T(0));
+    if (w_ == 0 || h_ == 0) return;
+
+    // Полос по нескольку на поток: больше — дороже переносы, меньше — хуже балансировка.
+    // В один поток полоса одна, и второго прохода нет.
+    const int perBand = (h_ + 4 * threadCount() - 1) / (4 * threadCount());
+    const int bandRows = threadCount() > 1 ? std::max({ 32, Parallel::rowsPerBand(w_), perBand }) : h_;
+    const int bands = (h_ + bandRows - 1) / bandRows;
+
+    // 1) таблица каждой полосы от её первой строки
+    Parallel::forRange(0, bands, 1, [&](int b0, int b1) {
+        for (int b = b0; b < b1; ++b) {
+            const int yb = b * bandRows, ye = std::min(h_, yb + bandRows);
+            for (int y = yb; y < ye; ++y) {
+                const uchar* s = gray.constScanLine(y);
+                const T* up = y > yb ? row(y) : nullptr;
+                T* d = rowMut(y + 1);
+                T acc = 0;
+                d[0] = 0;
+                for (int x = 0; x < w_; ++x) {
+                    acc += Squares ? T(s[x]) * s[x] : T(s[x]);
+                    d[x + 1] = up ? T(acc + up[x + 1]) : acc;
+                }
+            }
+        }
+    });
+
+    // 2) переносы: последняя строка полосы становится итоговой
+    auto lastRow = [&](int b) { return std::min(h_, (b + 1) * bandRows); };
+    for (int b = 1; b < bands; ++b) {
+        const T* carry = row(lastRow(b - 1));
+        T* d = rowMut(lastRow(b));
+        for (size_t x = 1; x < stride_; ++x) d[x] += carry[x];
+    }
+    Parallel::forRange(1, bands, 1, [&](int b0, int b1) {
+        for (int b = b0; b < b1; ++b) {
+            const T* carry = row(lastRow(b - 1));
+            for (int y = b * bandRows + 1; y < lastRow(b); ++y) {
+                T* d = rowMut(y);
+                for (size_t x = 1; x < stride_; ++x) d[x] += carry[x];
+            }
+        }
+    });
+}
+
+} // namespace Img
@@ -1,6 +1,6 @@
 #include <QApplication>
 #include <QFile>
-#include "MainWindow.h"
+#include "mainwindow.h"
 
 int main(int argc, char *argv[])
 {
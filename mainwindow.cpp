@@ -1,8 +1,12 @@
-#include "MainWindow.h"
-#include "ImageProcessor.h"
+#include "mainwindow.h"
+#include "imageprocessor.h"
+#include "mappedio.h"
+#include "maskio.h"
+#include "pipeline.h"
 
 #include <QAction>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QHBoxLayout>
 #include <QGridLayout>
 #include <QLabel>
@@ -18,6 +22,31 @@
 #include <QFormLayout>
 #include <QGuiApplication>
 #include <QScreen>
+#include <QCheckBox>
+#include <QProgressBar>
+#include <QTimer>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+
+// Пауза в настройке параметров, после которой пересчитывается вид: удержание стрелки
+// спин-бокса не ставит в очередь по задаче на каждый шаг
+static const int kDebounceMs = 150;
+
+// Прямоугольник в масштабе k: захватывает все пиксели, которых касается r
+static QRect scaleRect(const QRect& r, double k)
+{
+    return QRect(QPoint(int(std::floor(r.left() * k)), int(std::floor(r.top() * k))),
+                 QPoint(int(std::ceil((r.right() + 1) * k)) - 1, int(std::ceil((r.bottom() + 1) * k)) - 1));
+}
+
+// Детектор операции op (2 — Собель, 3 — линии, 4 — точки)
+static Img::DetectorFlag detectorFlag(int op)
+{
+    if (op == 2) return Img::DetectSobel;
+    if (op == 3) return Img::DetectLines;
+    return Img::DetectPoints;
+}
 
 static QLabel* makeImageLabel() {
     auto* lab = new QLabel;
@@ -34,6 +63,13 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
     statusBar()->showMessage("Откройте изображение (Файл → Открыть)...");
 }
 
+MainWindow::~MainWindow()
+{
+    // Фоновые задачи не ссылаются на окно, но пусть не досчитывают зря
+    if (fullControl_) fullControl_->cancel();
+    if (previewControl_) previewControl_->cancel();
+}
+
     void MainWindow::buildUi()
 {
     // --- Меню ---
@@ -99,17 +135,18 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
         "Адаптивная пороговая обработка",
         "Обнаружение границ (Собель)",
         "Обнаружение линий (ядра)",
-        "Обнаружение точек (Лаплас)"
+        "Обнаружение точек (Лаплас)",
+        "Детектор Канни"
     });
 
     comboGlobal_ = new QComboBox;
-    comboGlobal_->addItems({ "Метод Отсу", "Метод среднего значения" });
+    comboGlobal_->addItems({ "Метод Отсу", "Метод среднего значения", "Итеративный метод (ISODATA)" });
 
     comboAdapt_ = new QComboBox;
-    comboAdapt_->addItems({ "α-метод" });
+    comboAdapt_->addItems({ "α-метод", "Ниблэк", "Саувола", "Вульф", "Брэдли–Рот" });
 
     winSize_ = new QSpinBox;
-    winSize_->setRange(3, 99);
+    winSize_->setRange(3, 1001);
     winSize_->setSingleStep(2);
     winSize_->setValue(25);
 
@@ -120,6 +157,12 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
     alphaSpin_->setDecimals(2);           // два знака после запятой
     alphaSpin_->setValue(2.0 / 3.0);      // значение по умолчанию
 
+    // k локальных методов; при смене метода ставится его типичное значение
+    kSpin_ = new QDoubleSpinBox;
+    kSpin_->setRange(-1.0, 1.0);
+    kSpin_->setSingleStep(0.05);
+    kSpin_->setDecimals(2);
+    kSpin_->setEnabled(false);
 
     sobelTh_ = new QSpinBox;
     sobelTh_->setRange(0, 4096);
@@ -133,12 +176,109 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
     pointTh_->setRange(0, 4096);
     pointTh_->setValue(150);
 
+    // Канни: слабые границы (от нижнего порога) остаются, только если связаны с сильными
+    cannyLow_ = new QSpinBox;
+    cannyLow_->setRange(0, 4096);
+    cannyLow_->setValue(50);
+
+    cannyHigh_ = new QSpinBox;
+    cannyHigh_->setRange(0, 4096);
+    cannyHigh_->setValue(120);
+
+    // Сглаживание перед детекторами: шум сканов не раздувает отклики
+    sigma_ = new QDoubleSpinBox;
+    sigma_->setRange(0.0, 20.0);
+    sigma_->setSingleStep(0.5);
+    sigma_->setDecimals(1);
+    sigma_->setValue(0.0);
+    sigma_->setSpecialValueText("нет");
+
+    // Медиана перед любой операцией: убирает шум «соль и перец», не размывая края
+    median_ = new QSpinBox;
+    median_->setRange(0, 50);
+    median_->setValue(0);
+    median_->setSpecialValueText("нет");
+    median_->setToolTip("Радиус r медианного фильтра (окно 2r+1)");
+
+    // При готовой карте откликов новый порог применяется сразу
+    connect(sobelTh_, qOverload<int>(&QSpinBox::valueChanged), this, &MainWindow::thresholdChanged);
+    connect(lineTh_,  qOverload<int>(&QSpinBox::valueChanged), this, &MainWindow::thresholdChanged);
+    connect(pointTh_, qOverload<int>(&QSpinBox::valueChanged), this, &MainWindow::thresholdChanged);
+    connect(sigma_, qOverload<double>(&QDoubleSpinBox::valueChanged), this, &MainWindow::parametersChanged);
+    connect(median_, qOverload<int>(&QSpinBox::valueChanged), this, &MainWindow::parametersChanged);
+    connect(cannyLow_,  qOverload<int>(&QSpinBox::valueChanged), this, &MainWindow::parametersChanged);
+    connect(cannyHigh_, qOverload<int>(&QSpinBox::valueChanged), this, &MainWindow::parametersChanged);
+
     // --- Кнопка ---
     btnApply_ = new QPushButton("ПРИМЕНИТЬ");
     btnApply_->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
     btnApply_->setFixedHeight(45);
     connect(btnApply_, &QPushButton::clicked, this, &MainWindow::applyOperation);
 
+    // --- Живой предпросмотр ---
+    liveCheck_ = new QCheckBox("Живой предпросмотр");
+    liveCheck_->setToolTip("После паузы в изменении параметров пересчитывается видимая часть в масштабе экрана;\n"
+                           "полное разрешение считается при сохранении");
+    debounce_ = new QTimer(this);
+    debounce_->setSingleShot(true);
+    debounce_->setInterval(kDebounceMs);
+    connect(debounce_, &QTimer::timeout, this, [this] { startProcessing(Pass::View); });
+    connect(liveCheck_, &QCheckBox::toggled, this, &MainWindow::parametersChanged);
+
+    // --- Этапы после бинаризации: очистка маски морфологией, связные компоненты ---
+    comboMorph_ = new QComboBox;
+    comboMorph_->addItems({ "нет", "эрозия", "дилатация", "размыкание", "замыкание" });
+    comboMorph_->setToolTip("Операция над белыми пикселями маски: размыкание убирает белые крапинки,\n"
+                            "замыкание — чёрные (например, шум α-метода на светлом фоне)");
+    comboShape_ = new QComboBox;
+    comboShape_->addItems({ "прямоугольник", "крест" });
+    morphSize_ = new QSpinBox;
+    morphSize_->setRange(1, 201);
+    morphSize_->setValue(3);
+    connect(comboMorph_, qOverload<int>(&QComboBox::currentIndexChanged), this, &MainWindow::parametersChanged);
+    connect(comboShape_, qOverload<int>(&QComboBox::currentIndexChanged), this, &MainWindow::parametersChanged);
+    connect(morphSize_, qOverload<int>(&QSpinBox::valueChanged), this, &MainWindow::parametersChanged);
+
+
+    componentsCheck_ = new QCheckBox("Связные компоненты");
+    componentsCheck_->setToolTip("После операции маска размечается на 8-связные области;\n"
+                                 "их число, средняя площадь и наибольшая — в строке состояния");
+    connect(componentsCheck_, &QCheckBox::toggled, this, &MainWindow::parametersChanged);
+
+    houghCheck_ = new QCheckBox("Отрезки Хафа");
+    houghCheck_->setToolTip("На маске детектора ищутся отрезки прямых (преобразование Хафа);\n"
+                            "их число и самый длинный — в строке состояния");
+    houghLength_ = new QSpinBox;
+    houghLength_->setRange(5, 5000);
+    houghLength_->setValue(30);
+    houghLength_->setToolTip("Минимальная длина отрезка и число голосов за прямую, пикселей");
+    connect(houghCheck_, &QCheckBox::toggled, this, &MainWindow::parametersChanged);
+    connect(houghLength_, qOverload<int>(&QSpinBox::valueChanged), this, &MainWindow::parametersChanged);
+    connect(alphaSpin_, qOverload<double>(&QDoubleSpinBox::valueChanged), this, &MainWindow::parametersChanged);
+    connect(winSize_, qOverload<int>(&QSpinBox::valueChanged), this, &MainWindow::parametersChanged);
+    connect(kSpin_, qOverload<double>(&QDoubleSpinBox::valueChanged), this, &MainWindow::parametersChanged);
+    connect(comboAdapt_, qOverload<int>(&QComboBox::currentIndexChanged), this, &MainWindow::adaptMethodChanged);
+    connect(comboOp_, qOverload<int>(&QComboBox::currentIndexChanged), this, &MainWindow::parametersChanged);
+    connect(comboGlobal_, qOverload<int>(&QComboBox::currentIndexChanged), this, &MainWindow::parametersChanged);
+
+    // --- Ход фоновой обработки: прогресс и отмена в строке состояния ---
+    progress_ = new QProgressBar;
+    progress_->setRange(0, 100);
+    progress_->setMaximumWidth(220);
+    progress_->hide();
+    btnCancel_ = new QPushButton("Отмена");
+    btnCancel_->hide();
+    connect(btnCancel_, &QPushButton::clicked, this, &MainWindow::cancelProcessing);
+    statusBar()->addPermanentWidget(progress_);
+    statusBar()->addPermanentWidget(btnCancel_);
+
+    progressTimer_ = new QTimer(this);
+    progressTimer_->setInterval(50);
+    connect(progressTimer_, &QTimer::timeout, this, &MainWindow::updateProgress);
+
+    connect(&fullWatcher_, &QFutureWatcher<Result>::finished, this, &MainWindow::processingFinished);
+    connect(&previewWatcher_, &QFutureWatcher<Result>::finished, this, &MainWindow::previewFinished);
+
     // --- Компоновка элементов управления ---
     QGridLayout* controls = new QGridLayout;
     controls->setHorizontalSpacing(25);
@@ -179,8 +319,11 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
     // --- Блок 3: адаптивный метод ---
     QHBoxLayout* alphaLayout = new QHBoxLayout;
     alphaLayout->setSpacing(8);
+    alphaLayout->addWidget(comboAdapt_);
     alphaLayout->addWidget(new QLabel("α:"));
     alphaLayout->addWidget(alphaSpin_);
+    alphaLayout->addWidget(new QLabel("k:"));
+    alphaLayout->addWidget(kSpin_);
     alphaLayout->addWidget(new QLabel("Размер окна:"));
     alphaLayout->addWidget(winSize_);
     alphaLayout->addStretch();
@@ -204,7 +347,15 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
     QHBoxLayout* threshLayout = new QHBoxLayout;
     threshLayout->setSpacing(3); // расстояние между блоками
 
-    // Собель
+    // Предобработка: медиана (для всех операций) и σ (для детекторов)
+    threshLayout->addWidget(new QLabel("Медиана:"));
+    threshLayout->addWidget(median_);
+
+    threshLayout->addSpacing(6);
+    threshLayout->addWidget(new QLabel("σ:"));
+    threshLayout->addWidget(sigma_);
+
+    threshLayout->addSpacing(6);
     threshLayout->addWidget(new QLabel("Порог Собеля:"));
     threshLayout->addWidget(sobelTh_);
 
@@ -218,11 +369,44 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
     threshLayout->addWidget(new QLabel("Порог точек:"));
     threshLayout->addWidget(pointTh_);
 
+    // Канни
+    threshLayout->addSpacing(10);
+    threshLayout->addWidget(new QLabel("Канни:"));
+    threshLayout->addWidget(cannyLow_);
+    threshLayout->addWidget(new QLabel("–"));
+    threshLayout->addWidget(cannyHigh_);
 
     controls->addLayout(threshLayout, r, 0, 1, 5);
     r++;
 
 
+    // --- Блок 5: очистка маски ---
+    QHBoxLayout* morphLayout = new QHBoxLayout;
+    morphLayout->setSpacing(8);
+    morphLayout->addWidget(comboMorph_);
+    morphLayout->addWidget(new QLabel("Элемент:"));
+    morphLayout->addWidget(comboShape_);
+    morphLayout->addWidget(new QLabel("Размер:"));
+    morphLayout->addWidget(morphSize_);
+    morphLayout->addStretch();
+
+    controls->addWidget(new QLabel("Очистка маски:"), r, 0, Qt::AlignRight);
+    controls->addLayout(morphLayout, r, 1, 1, 4);
+    r++;
+
+    controls->addWidget(liveCheck_, r, 0, 1, 2);
+    controls->addWidget(componentsCheck_, r, 2, 1, 3);
+    r++;
+
+    QHBoxLayout* houghLayout = new QHBoxLayout;
+    houghLayout->setSpacing(8);
+    houghLayout->addWidget(houghCheck_);
+    houghLayout->addWidget(new QLabel("Мин. длина:"));
+    houghLayout->addWidget(houghLength_);
+    houghLayout->addStretch();
+    controls->addLayout(houghLayout, r, 2, 1, 3);
+    r++;
+
     // --- Разделитель перед кнопкой ---
     {
         QFrame* line = new QFrame;
@@ -271,35 +455,77 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
 
 void MainWindow::openImage()
 {
-    QString fn = QFileDialog::getOpenFileName(this, "Открыть изображение", {}, "Изображения (*.png *.jpg *.bmp)");
+    QString fn = QFileDialog::getOpenFileName(this, "Открыть изображение", {}, "Изображения (*.png *.jpg *.bmp *.pgm *.pbm)");
     if (fn.isEmpty()) return;
-    QImage img(fn);
+    // PGM/PBM отображаются в память без декодирования. Файл, доступный на запись,
+    // копируется сразу: его могут перезаписать, пока изображение открыто, и
+    // отображение осталось бы без страниц
+    QImage img = Img::mapImage(fn);
+    if (!img.isNull() && QFileInfo(fn).isWritable()) img = img.copy();
+    if (img.isNull()) img.load(fn);
     if (img.isNull()) {
         QMessageBox::warning(this, "Ошибка", "Не удалось загрузить изображение");
         return;
     }
 
+    // Задачи по старому изображению больше не нужны, их результаты не покажутся
+    debounce_->stop();
+    if (fullControl_) fullControl_->cancel();
+    if (previewControl_) previewControl_->cancel();
+    shownRequestId_ = imageRequestId_ = nextRequestId_++;
+    pendingSave_.clear();
+
     original_ = Img::toGrayscale(img);
     current_  = original_;
+    resultIsFull_ = true;
+    stats_    = Img::ImageStats();
+    sobelResp_ = lineResp_ = pointResp_ = QImage();
+    viewResp_ = QImage();
+    viewRespKey_ = ViewKey();
+    origView_.setImage(original_);
     updatePreview(current_);
-    viewOrig_->setPixmap(QPixmap::fromImage(original_).scaled(
-        viewOrig_->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    viewOrig_->setPixmap(origView_.pixmap(viewOrig_->size()));
     statusBar()->showMessage("Изображение загружено: " + fn);
 }
 
 void MainWindow::saveImage()
 {
     if (current_.isNull()) { QMessageBox::information(this, "Сохранение", "Нет обработанного изображения"); return; }
-    QString fn = QFileDialog::getSaveFileName(this, "Сохранить изображение", "результат.png", "PNG Image (*.png)");
+    QString fn = QFileDialog::getSaveFileName(this, "Сохранить изображение", "результат.png",
+                                              "PNG Image (*.png);;PBM Image (*.pbm);;PGM Image (*.pgm);;TIFF Image (*.tif *.tiff)");
     if (fn.isEmpty()) return;
-    current_.save(fn);
-    statusBar()->showMessage("Сохранено: " + fn);
+    if (resultIsFull_) {
+        writeCurrent(fn);
+        return;
+    }
+    // На экране только видимая часть в масштабе экрана — полное разрешение считаем сейчас
+    pendingSave_ = fn;
+    startProcessing(Pass::Full);
+    statusBar()->showMessage("Расчёт в полном разрешении для сохранения...");
+}
+
+// Результат обработки — упакованная маска: пишется с 1 битом на пиксель;
+// PGM/PBM пишутся прямо в отображение файла
+void MainWindow::writeCurrent(const QString& fn)
+{
+    const bool ok = Img::isMappedSuffix(fn)                     ? Img::saveMapped(current_, fn)
+                  : current_.format() == QImage::Format_MonoLSB ? Img::saveMask(current_, fn)
+                                                                 : current_.save(fn);
+    statusBar()->showMessage((ok ? "Сохранено: " : "Не удалось сохранить: ") + fn);
 }
 
 void MainWindow::resetImage()
 {
     if (original_.isNull()) return;
+    // Недосчитанные и отложенные результаты не должны перекрыть сброшенное изображение
+    debounce_->stop();
+    if (fullControl_) fullControl_->cancel();
+    if (previewControl_) previewControl_->cancel();
+    shownRequestId_ = nextRequestId_++;
+    pendingSave_.clear();
+
     current_ = original_;
+    resultIsFull_ = true;
     updatePreview(current_);
     statusBar()->showMessage("Изображение сброшено");
 }
@@ -310,56 +536,400 @@ void MainWindow::applyOperation()
         QMessageBox::information(this, "Информация", "Сначала откройте изображение.");
         return;
     }
+    debounce_->stop();
+    startProcessing(Pass::View);
+}
 
-    const QImage gray = original_;
-    QImage out;
-    const int op = comboOp_->currentIndex();
+MainWindow::Request MainWindow::makeRequest(Pass pass)
+{
+    Request req;
+    req.id = nextRequestId_++;
+    req.original = original_;
+    req.gray = original_;
+    req.op = comboOp_->currentIndex();
+    req.globalMethod = comboGlobal_->currentIndex();
+    req.adaptMethod = comboAdapt_->currentIndex();
+    req.alpha = alphaSpin_->value();
+    req.k = kSpin_->value();
+    req.window = winSize_->value();
+    req.stats = stats_;
+
+    switch (req.op) {
+    case 2: req.threshold = sobelTh_->value(); break;
+    case 3: req.threshold = lineTh_->value();  break;
+    case 4: req.threshold = pointTh_->value(); break;
+    case 5: req.low = cannyLow_->value(); req.threshold = cannyHigh_->value(); break;
+    }
+    if (req.op >= 2) req.sigma = sigma_->value();
+    req.components = componentsCheck_->isChecked();
+    req.hough = houghCheck_->isChecked();
+    req.houghLength = houghLength_->value();
+    req.median = median_->value();
+    req.morph = comboMorph_->currentIndex() - 1;
+    req.morphShape = comboShape_->currentIndex();
+    req.morphSize = morphSize_->value();
+
+    if (pass == Pass::View) {
+        const QSize fitted = original_.size().scaled(viewProc_->size(), Qt::KeepAspectRatio);
+        const QRect visible = visibleImageRect(fitted);
+        // Изображение не уменьшено и видно целиком — это и есть полный проход
+        if (fitted.width() < original_.width() || visible != original_.rect()) {
+            req.full = false;
+            req.viewSize = fitted.boundedTo(original_.size());
+            const double toView = double(req.viewSize.width()) / original_.width();
+            // Источник — ближайший уровень пирамиды отображения, а не полное изображение
+            req.gray = origView_.levelFor(req.viewSize);
+            const double toLevel = double(req.gray.width()) / original_.width();
+            req.roi = scaleRect(visible, toLevel).intersected(req.gray.rect());
+            req.scale = double(req.viewSize.width()) / req.gray.width();
+            req.viewAt = scaleRect(visible, toView).topLeft();
+            // Окно адаптивных методов масштабируется вместе с изображением (нечётное, не меньше 3)
+            req.window = std::max(3, int(req.window * toView) | 1);
+            req.morphSize = std::max(1, int(req.morphSize * toView));
+            req.houghLength = std::max(5, qRound(req.houghLength * toView));
+            if (req.median > 0) req.median = std::max(1, qRound(req.median * toView));
+            req.sigma *= toView;
+            if (req.op >= 2 && req.op <= 4) {
+                req.viewKey = { req.gray.cacheKey(), req.roi, req.scale, req.op, req.sigma,
+                                req.median, req.morph, req.morphSize };
+                if (req.viewKey == viewRespKey_) req.response = viewResp_;
+            }
+            return req;
+        }
+    }
+
+    // Кэши полного разрешения уходят в задачу, посчитанное в ней возвращается обратно
+    if (req.sigma != respSigma_ || req.median != respMedian_) return req;
+    if (req.op == 2) req.response = sobelResp_;
+    if (req.op == 3) req.response = lineResp_;
+    if (req.op == 4) req.response = pointResp_;
+    return req;
+}
+
+// Часть original_, видимая в viewProc_ (метка в области прокрутки бывает больше окна),
+// в координатах изображения; fitted — размер изображения на экране
+QRect MainWindow::visibleImageRect(const QSize& fitted) const
+{
+    const QRect shown(QPoint((viewProc_->width() - fitted.width()) / 2,
+                             (viewProc_->height() - fitted.height()) / 2), fitted);
+    const QRect visible = viewProc_->visibleRegion().boundingRect().intersected(shown);
+    if (visible.isEmpty() || fitted.isEmpty()) return original_.rect();   // окно ещё не показано
+    return scaleRect(visible.translated(-shown.topLeft()), double(original_.width()) / fitted.width())
+        .intersected(original_.rect());
+}
+
+// Выполняется в фоновом потоке: только Img и данные из запроса
+MainWindow::Result MainWindow::process(const Request& req, const std::shared_ptr<Img::TaskControl>& control)
+{
+    Img::setTaskControl(control.get());
+    Img::resetParallelStats();
+
+    Result res;
+    res.id = req.id;
+    res.full = req.full;
+    res.op = req.op;
+    res.sigma = req.sigma;
+    res.median = req.median;
+    res.viewSize = req.viewSize;
+    res.viewAt = req.viewAt;
+    // Полный проход идёт на сохранение — маска сразу упакованная, 1 бит на пиксель
+    const Img::MaskFormat mask = req.full ? Img::MaskFormat::Mono : Img::MaskFormat::Gray8;
+
+    // Операция — конвейер Img::Pipeline: медиана перед ней и очистка маски после
+    // идут плитками вместе с ней, без промежуточных изображений во всё изображение
+    auto prepared = [&req]() {
+        Img::Pipeline p;
+        if (req.median > 0) p.median(req.median);
+        return p;
+    };
+    auto clean = [&req](Img::Pipeline p) {
+        if (req.morph >= 0)
+            p.morphology(Img::MorphOp(req.morph), req.morphSize, req.morphSize, Img::StructShape(req.morphShape));
+        return p;
+    };
+
+    // Полный проход — конвейер по всему изображению; вид — только roi с ореолом конвейера
+    auto run = [&req, mask](const QImage& src, const Img::Pipeline& p) {
+        return req.full ? p.run(src, mask) : Img::processRegion(src, req.roi, req.scale, p.regionOp());
+    };
 
     // --- Глобальная пороговая обработка ---
-    if (op == 0) {
-        switch (comboGlobal_->currentIndex()) {
+    if (req.op == 0) {
+        // Гистограмма — всегда по полному изображению и один раз: смена метода и
+        // проход по виду её не пересчитывают, порог не зависит от видимой области.
+        // С медианой гистограмма — отфильтрованного изображения (в виде — уровня
+        // пирамиды) и в кэш не идёт; порог тогда считается по нему же
+        const QImage source = req.median > 0 ? Img::medianFilter(req.gray, req.median) : req.gray;
+        Img::ImageStats filtered;
+        if (req.median > 0)
+            filtered = Img::ImageStats::compute(source);
+        else
+            res.stats = req.stats.isEmpty() ? Img::ImageStats::compute(req.original) : req.stats;
+        const Img::ImageStats& stats = req.median > 0 ? filtered : res.stats;
+        Img::Pipeline p;
+        switch (req.globalMethod) {
         case 0:
-            out = Img::thresholdOtsu(gray);
-            statusBar()->showMessage("Глобальная пороговая обработка (метод Отсу)");
+            p.stage(0, [&stats](const QImage& g) { return Img::thresholdOtsu(g, stats); });
+            res.message = "Глобальная пороговая обработка (метод Отсу)";
             break;
         case 1:
-            out = Img::thresholdMean(gray);
-            statusBar()->showMessage("Глобальная пороговая обработка (метод среднего значения)");
+            p.stage(0, [&stats](const QImage& g) { return Img::thresholdMean(g, stats); });
+            res.message = "Глобальная пороговая обработка (метод среднего значения)";
+            break;
+        case 2:
+            p.stage(0, [&stats](const QImage& g) { return Img::thresholdIterative(g, stats); });
+            res.message = "Глобальная пороговая обработка (итеративный метод)";
             break;
         }
+        res.out = run(source, clean(p));
 
         // --- Адаптивная пороговая обработка ---
-    } else if (op == 1) {
-    out = Img::adaptiveAlpha(gray, winSize_->value(), alphaSpin_->value());
-    statusBar()->showMessage(QString("Адаптивная пороговая обработка (α = %1)").arg(alphaSpin_->value(), 0, 'f', 2));
+    } else if (req.op == 1 && req.adaptMethod == 0) {
+        res.out = run(req.gray, clean(prepared().stage(req.window / 2, [&req](const QImage& g) {
+            return Img::adaptiveAlpha(g, req.window, req.alpha); })));
+        res.message = QString("Адаптивная пороговая обработка (α = %1)").arg(req.alpha, 0, 'f', 2);
+    } else if (req.op == 1) {
+        // Вульф нормирует по всему изображению — этап целиком, а не плитками;
+        // в проходе по виду — по видимой области
+        const auto method = Img::LocalMethod(req.adaptMethod - 1);
+        res.out = run(req.gray, clean(prepared().stage(req.window / 2, [&req, method](const QImage& g) {
+            return Img::thresholdLocal(g, method, req.window, req.k); }, method == Img::LocalMethod::Wolf)));
+        static const char* names[] = { "Ниблэк", "Саувола", "Вульф", "Брэдли–Рот" };
+        res.message = QString("Адаптивная пороговая обработка (%1, k = %2)")
+                          .arg(names[req.adaptMethod - 1]).arg(req.k, 0, 'f', 2);
+
+        // --- Канни: своя цепочка, карта откликов не кэшируется ---
+    } else if (req.op == 5) {
+        // Гистерезис связывает границы через всё изображение, поэтому вид с ореолом
+        // лишь приближает полный результат: цепочки, ушедшие за ореол, могут пропасть
+        Img::Pipeline p = prepared();
+        if (req.sigma > 0) p.gaussian(req.sigma);
+        p.stage(2, [&req](const QImage& g) { return Img::edgesCanny(g, req.low, req.threshold); }, true);
+        res.out = run(req.gray, clean(p));
+        res.message = QString("Детектор Канни (пороги %1–%2)").arg(req.low).arg(req.threshold);
+        if (req.sigma > 0) res.message += QString(", σ = %1").arg(req.sigma, 0, 'f', 1);
+
+        // --- Детекторы: карта откликов (из кэша или новая) + порог ---
+    } else {
+        // Сглаживание — в том же конвейере перед детектором; ореол вида растёт на радиус ядра
+        Img::Pipeline p = prepared();
+        if (req.sigma > 0) p.gaussian(req.sigma);
+        p.response(detectorFlag(req.op));
+        if (req.full) {
+            res.response = req.response.isNull() ? p.run(req.gray) : req.response;
+            res.out = clean(Img::Pipeline().threshold(req.threshold)).run(res.response, mask);
+        } else {
+            // Карта откликов рабочей области вида (с ореолом и очисткой) — из кэша или новая;
+            // ореол тот же, что у конвейера целиком, поэтому и результат тот же
+            const Img::Pipeline finish = clean(Img::Pipeline().threshold(req.threshold));
+            QImage viewResp;
+            const Img::RegionOp op{ p.halo() + finish.halo(), [&](const QImage& g) {
+                viewResp = req.response.size() == g.size() ? req.response : p.run(g);
+                return finish.run(viewResp);
+            } };
+            res.out = Img::processRegion(req.gray, req.roi, req.scale, op);
+            res.response = viewResp;
+            res.viewKey = req.viewKey;
+        }
+        if (req.op == 2) res.message = "Обнаружение границ (оператор Собеля)";
+        if (req.op == 3) res.message = "Обнаружение линий";
+        if (req.op == 4) res.message = "Обнаружение точек (оператор Лапласа)";
+        if (req.sigma > 0) res.message += QString(", σ = %1").arg(req.sigma, 0, 'f', 1);
+    }
+
+    if (req.median > 0) res.message += QString(", медиана r = %1").arg(req.median);
+
+    // Компоненты: у пороговых методов объекты (текст) чёрные, у детекторов — белые отклики.
+    // В проходе по виду — только видимая часть в масштабе экрана
+    if (req.components && !res.out.isNull() && !control->isCancelled()) {
+        const Img::Components comps = Img::labelComponents(res.out, req.op >= 2);
+        qint64 total = 0, largest = 0;
+        for (const Img::Component& c : comps.list) {
+            total += c.area;
+            largest = std::max(largest, c.area);
+        }
+        res.message += QString("; компонент%1: %2").arg(req.full ? "" : " в видимой части").arg(comps.count());
+        if (comps.count() > 0)
+            res.message += QString(" (средняя площадь %1, наибольшая %2)")
+                               .arg(double(total) / comps.count(), 0, 'f', 1).arg(largest);
+    }
+
+    // Отрезки — только у детекторов: их маска — белые отклики на тёмном фоне
+    if (req.hough && req.op >= 2 && !res.out.isNull() && !control->isCancelled()) {
+        Img::HoughParams params;
+        params.minLength = params.minVotes = req.houghLength;
+        const std::vector<Img::HoughLine> lines = Img::houghLines(res.out, params);
+        double longest = 0.0;
+        for (const Img::HoughLine& l : lines)
+            longest = std::max(longest, std::hypot(l.p2.x() - l.p1.x(), l.p2.y() - l.p1.y()));
+        res.message += QString("; отрезков%1: %2").arg(req.full ? "" : " в видимой части").arg(int(lines.size()));
+        if (!lines.empty()) res.message += QString(" (самый длинный %1 пикс.)").arg(longest, 0, 'f', 0);
+    }
+
+    res.parallel = Img::parallelStats();
+    res.cancelled = control->isCancelled();
+    Img::setTaskControl(nullptr);
+    return res;
+}
 
+void MainWindow::startProcessing(Pass pass)
+{
+    if (original_.isNull()) return;
+
+    const Request req = makeRequest(pass);
+    auto control = std::make_shared<Img::TaskControl>();
+    // Предыдущая задача того же вида, если ещё идёт, досчитает до ближайшей полосы и будет забыта
+    if (!req.full) {
+        if (previewControl_) previewControl_->cancel();
+        previewControl_ = control;
+        previewWatcher_.setFuture(QtConcurrent::run([req, control] { return process(req, control); }));
+        return;
+    }
 
-        // --- Обнаружение границ ---
-    } else if (op == 2) {
-        out = Img::edgesSobel(gray, sobelTh_->value());
-        statusBar()->showMessage("Обнаружение границ (оператор Собеля)");
+    if (fullControl_) fullControl_->cancel();
+    fullControl_ = control;
+    fullWatcher_.setFuture(QtConcurrent::run([req, control] { return process(req, control); }));
 
-        // --- Обнаружение линий ---
-    } else if (op == 3) {
-        out = Img::linesKernels(gray, lineTh_->value());
-        statusBar()->showMessage("Обнаружение линий");
+    progress_->setValue(0);
+    progress_->show();
+    btnCancel_->show();
+    progressTimer_->start();
+}
+
+void MainWindow::storeCaches(const Result& res)
+{
+    // Кэши — только если результат посчитан для текущего изображения
+    if (res.id <= imageRequestId_) return;
+    if (!res.stats.isEmpty()) stats_ = res.stats;
+    if (!res.full) {
+        if (!res.response.isNull()) {
+            viewResp_ = res.response;
+            viewRespKey_ = res.viewKey;
+        }
+        return;
+    }
+    // Карты, посчитанные при другом σ или другой медиане, больше не годятся
+    if (!res.response.isNull() && (res.sigma != respSigma_ || res.median != respMedian_)) {
+        sobelResp_ = lineResp_ = pointResp_ = QImage();
+        respSigma_ = res.sigma;
+        respMedian_ = res.median;
+    }
+    if (res.op == 2 && !res.response.isNull()) sobelResp_ = res.response;
+    if (res.op == 3 && !res.response.isNull()) lineResp_  = res.response;
+    if (res.op == 4 && !res.response.isNull()) pointResp_ = res.response;
+}
+
+void MainWindow::processingFinished()
+{
+    progressTimer_->stop();
+    progress_->hide();
+    btnCancel_->hide();
+
+    const Result res = fullWatcher_.result();
+    if (res.cancelled) {
+        pendingSave_.clear();
+        statusBar()->showMessage("Обработка отменена");
+        return;
+    }
+    if (res.id <= imageRequestId_) return;   // посчитано для прежнего изображения
 
-        // --- Обнаружение точек ---
-    } else if (op == 4) {
-        out = Img::pointsLaplacian(gray, pointTh_->value());
-        statusBar()->showMessage("Обнаружение точек (оператор Лапласа)");
+    storeCaches(res);
+    current_ = res.out;
+    if (!pendingSave_.isEmpty()) {
+        writeCurrent(pendingSave_);
+        pendingSave_.clear();
     }
+    if (res.id < shownRequestId_) return;
+    shownRequestId_ = res.id;
 
-    current_ = out;
+    resultIsFull_ = true;
     updatePreview(current_);
+
+    // Время и эффективность параллельного выполнения
+    const Img::ParallelStats& st = res.parallel;
+    statusBar()->showMessage(res.message +
+        QString("  —  %1 мс, потоков: %2, эффективность: %3%")
+            .arg(st.wallMs, 0, 'f', 1).arg(st.threads).arg(qRound(st.efficiency() * 100)));
+}
+
+void MainWindow::previewFinished()
+{
+    const Result res = previewWatcher_.result();
+    if (res.cancelled) return;
+    storeCaches(res);
+    if (res.id < shownRequestId_) return;
+    shownRequestId_ = res.id;
+
+    // Вид только показывается: current_ (и сохранение) — полное разрешение
+    resultIsFull_ = false;
+    updatePreview(composeView(res));
+    statusBar()->showMessage(res.message +
+        QString("  —  видимая часть %1×%2, %3 мс")
+            .arg(res.out.width()).arg(res.out.height()).arg(res.parallel.wallMs, 0, 'f', 1));
+}
+
+// Результат прохода по виду на месте видимой части; остальное — оригинал в том же масштабе
+QImage MainWindow::composeView(const Result& res)
+{
+    if (res.out.size() == res.viewSize) return res.out;
+    QImage canvas = Img::resizeGray(origView_.levelFor(res.viewSize), res.viewSize);
+    const QRect dst = QRect(res.viewAt, res.out.size()).intersected(canvas.rect());
+    for (int y = dst.top(); y <= dst.bottom(); ++y)
+        std::copy_n(res.out.constScanLine(y - res.viewAt.y()) + (dst.left() - res.viewAt.x()),
+                    dst.width(), canvas.scanLine(y) + dst.left());
+    return canvas;
+}
+
+void MainWindow::cancelProcessing()
+{
+    if (fullControl_) fullControl_->cancel();
+    statusBar()->showMessage("Отмена...");
 }
 
+void MainWindow::updateProgress()
+{
+    if (!fullControl_) return;
+    progress_->setValue(qRound(fullControl_->passProgress() * 100));
+    progress_->setFormat(QString("проход %1: %p%").arg(fullControl_->passes.load()));
+}
 
+void MainWindow::parametersChanged()
+{
+    if (!liveCheck_->isChecked() || original_.isNull()) return;
+    // Пересчитывается только видимая часть в масштабе экрана — когда настройка
+    // остановится на kDebounceMs; полное разрешение — при сохранении
+    debounce_->start();
+}
+
+void MainWindow::adaptMethodChanged()
+{
+    // α — только у α-метода, k — у остальных
+    const int method = comboAdapt_->currentIndex();
+    alphaSpin_->setEnabled(method == 0);
+    kSpin_->setEnabled(method > 0);
+    if (method > 0) {
+        const QSignalBlocker block(kSpin_);
+        kSpin_->setValue(Img::localDefaultK(Img::LocalMethod(method - 1)));
+    }
+    parametersChanged();
+}
+
+void MainWindow::thresholdChanged()
+{
+    if (liveCheck_->isChecked()) {
+        parametersChanged();
+        return;
+    }
+    // Без живого предпросмотра пересчитываем сразу, если карта откликов для этого
+    // вида (или полного разрешения, когда изображение видно целиком) уже есть:
+    // остаётся только порог
+    if (!original_.isNull() && !makeRequest(Pass::View).response.isNull()) applyOperation();
+}
 
 void MainWindow::updatePreview(const QImage& img)
 {
-    viewProc_->setPixmap(QPixmap::fromImage(img).scaled(
-        viewProc_->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    procView_.setImage(img);
+    viewProc_->setPixmap(procView_.pixmap(viewProc_->size()));
 }
 
 
@@ -367,12 +937,11 @@ void MainWindow::resizeEvent(QResizeEvent* event)
 {
     QMainWindow::resizeEvent(event);
 
-    if (!original_.isNull())
-        viewOrig_->setPixmap(QPixmap::fromImage(original_).scaled(
-            viewOrig_->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    // Готовые pixmap'ы из кэша; при новом размере — пересглаживание ближайшего уровня пирамиды
+    if (!origView_.isNull())
+        viewOrig_->setPixmap(origView_.pixmap(viewOrig_->size()));
 
-    if (!current_.isNull())
-        viewProc_->setPixmap(QPixmap::fromImage(current_).scaled(
-            viewProc_->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    if (!procView_.isNull())
+        viewProc_->setPixmap(procView_.pixmap(viewProc_->size()));
 }
 
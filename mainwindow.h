@@ -1,7 +1,14 @@
 #pragma once
 #include <QMainWindow>
 #include <QImage>
+#include <QFutureWatcher>
+#include <memory>
+#include "imageprocessor.h"
+#include "previewcache.h"
 
+class QCheckBox;
+class QProgressBar;
+class QTimer;
 class QLabel;
 class QComboBox;
 class QSpinBox;
@@ -12,6 +19,7 @@ class MainWindow : public QMainWindow {
     Q_OBJECT
 public:
     explicit MainWindow(QWidget* parent=nullptr);
+    ~MainWindow() override;
 
 protected:
 void resizeEvent(QResizeEvent* event) override;
@@ -21,26 +29,150 @@ private slots:
     void saveImage();
     void resetImage();
     void applyOperation();
+    void thresholdChanged();
+    void parametersChanged();
+    void adaptMethodChanged();
+    void cancelProcessing();
+    void processingFinished();
+    void previewFinished();
+    void updateProgress();
 
 private:
+    // Полный проход — всё изображение в полном разрешении (для сохранения);
+    // проход по виду — только видимая часть в масштабе экрана (при настройке)
+    enum class Pass { Full, View };
+
+    // От чего зависит карта откликов прохода по виду: рабочая область (видимая часть
+    // с ореолом) на уровне пирамиды в масштабе экрана и этапы до порога. Очистка
+    // входит в ключ, потому что её размер расширяет ореол, а с ним и область
+    struct ViewKey {
+        qint64 level = 0;           // cacheKey уровня пирамиды
+        QRect roi;
+        double scale = 0.0;
+        int op = -1;
+        double sigma = 0.0;
+        int median = 0;
+        int morph = -1;
+        int morphSize = 0;
+
+        bool operator==(const ViewKey& o) const
+        {
+            return level == o.level && roi == o.roi && scale == o.scale && op == o.op && sigma == o.sigma
+                && median == o.median && morph == o.morph && morphSize == o.morphSize;
+        }
+    };
+
+    // Параметры операции, снятые с виджетов: фоновая задача не трогает GUI
+    struct Request {
+        int id = 0;                 // номер запроса; показывается только результат новее текущего
+        bool full = true;
+        QImage original;            // полное изображение: по нему считается гистограмма
+        QImage gray;                // источник операции (для вида — уровень пирамиды)
+        QRect roi;                  // вид: видимая область в координатах gray
+        double scale = 1.0;         // вид: масштаб экрана относительно gray
+        QSize viewSize;             // вид: размер всего изображения на экране
+        QPoint viewAt;              // вид: куда на экране попадает roi
+        int op = 0;
+        int globalMethod = 0;
+        int adaptMethod = 0;        // 0 — α-метод, далее Img::LocalMethod + 1
+        int window = 25;
+        double alpha = 0.67;
+        double k = 0.0;             // k локальных методов
+        int threshold = 0;          // для Канни — верхний порог
+        int low = 0;                // нижний порог Канни
+        double sigma = 0.0;         // сглаживание перед детектором
+        int morph = -1;             // очистка маски: Img::MorphOp, -1 — без неё
+        int morphShape = 0;         // Img::StructShape
+        int morphSize = 3;
+        bool components = false;    // разметить связные компоненты результата
+        bool hough = false;         // найти отрезки прямых на маске детектора
+        int houghLength = 30;       // их минимальная длина (и число голосов), пикселей
+        int median = 0;             // радиус медианы перед операцией (0 — без неё)
+        Img::ImageStats stats;      // кэш гистограммы (может быть пустым)
+        QImage response;            // кэш карты откликов выбранного детектора (может быть пустым)
+        ViewKey viewKey;            // вид: ключ карты откликов вида (op = -1 — не детектор)
+    };
+    struct Result {
+        int id = 0;
+        bool full = true;
+        bool cancelled = false;
+        int op = 0;
+        double sigma = 0.0;
+        int median = 0;
+        QImage out;
+        QSize viewSize;
+        QPoint viewAt;
+        Img::ImageStats stats;      // посчитанная гистограмма — в кэш
+        QImage response;            // посчитанная карта откликов — в кэш (полная или вида)
+        ViewKey viewKey;
+        QString message;
+        Img::ParallelStats parallel;
+    };
+
     void updatePreview(const QImage& img);
     void buildUi();
+    Request makeRequest(Pass pass);
+    QRect visibleImageRect(const QSize& fitted) const;
+    void startProcessing(Pass pass);
+    void storeCaches(const Result& res);
+    void writeCurrent(const QString& fn);
+    QImage composeView(const Result& res);
+    static Result process(const Request& req, const std::shared_ptr<Img::TaskControl>& control);
 
     QImage original_;
-    QImage current_;
+    QImage current_;            // последний результат в полном разрешении (маска — Format_MonoLSB)
+    bool resultIsFull_ = true;  // на экране current_, а не проход по виду
+    QString pendingSave_;       // куда сохранить, когда досчитается полный проход
+    Img::ImageStats stats_;  // кэш гистограммы original_ (пустой — ещё не посчитан)
+
+    // Кэш 16-битных карт откликов original_: смена порога — только бинаризация карты
+    QImage sobelResp_;
+    QImage lineResp_;
+    QImage pointResp_;
+    double respSigma_ = 0.0;    // при каком σ сглаживания посчитаны карты
+    int respMedian_ = 0;        // и при каком радиусе медианы
+    // Кэш карты откликов последнего прохода по виду: смена порога при том же виде —
+    // только порог и очистка, без свёртки и без полного прохода
+    QImage viewResp_;
+    ViewKey viewRespKey_;
+
+    // Фоновая обработка: полное разрешение и проходы по видимой области
+    QFutureWatcher<Result> fullWatcher_;
+    QFutureWatcher<Result> previewWatcher_;
+    std::shared_ptr<Img::TaskControl> fullControl_;
+    std::shared_ptr<Img::TaskControl> previewControl_;
+    int nextRequestId_ = 0;
+    int shownRequestId_ = -1;   // результат какого запроса сейчас на экране
+    int imageRequestId_ = 0;    // первый запрос для текущего original_ (старые не пишут в кэш)
+    QTimer* debounce_;          // пауза в настройке параметров -> проход по виду
+    QTimer* progressTimer_;
 
     QLabel* viewOrig_;
     QLabel* viewProc_;
+    PreviewPyramid origView_;   // кэш отображения original_
+    PreviewPyramid procView_;   // кэш отображения результата (полного или предпросмотра)
 
     QComboBox* comboOp_;     // выбор операции
-    QComboBox* comboGlobal_; // Otsu/Iterative
+    QComboBox* comboGlobal_; // Otsu/Mean/Iterative
     QComboBox* comboAdapt_;
     QDoubleSpinBox* alphaSpin_;     // список адаптивных
     QSpinBox*  winSize_;
-    QSpinBox*  adaptC_;      // не используется в α-методе, но оставлен в UI (на будущее)
-    QDoubleSpinBox* sigma_;  // "
+    QDoubleSpinBox* kSpin_;  // k методов Ниблэка/Сауволы/Вульфа/Брэдли
+    QSpinBox* median_;       // радиус медианы перед любой операцией (0 — без неё)
+    QDoubleSpinBox* sigma_;  // σ гауссова сглаживания перед детекторами (0 — без него)
     QSpinBox* sobelTh_;
     QSpinBox* lineTh_;
     QSpinBox* pointTh_;
+    QSpinBox* cannyLow_;
+    QSpinBox* cannyHigh_;
     QPushButton* btnApply_;
+    QCheckBox* liveCheck_;
+    QCheckBox* componentsCheck_;
+    QCheckBox* houghCheck_;  // отрезки прямых (Хаф) на маске детектора
+    QSpinBox* houghLength_;  // минимальная длина отрезка
+    QComboBox* comboMorph_;
+    QComboBox* comboShape_;
+    QSpinBox* morphSize_;
+    QProgressBar* progress_;
+    QPushButton* btnCancel_;
 };
@@ -0,0 +1,210 @@
+#include "mappedio.h"
+#include "imageprocessor.h"
+#include "parallel.h"
+#include "stream.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryFile>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#if defined(Q_OS_LINUX)
+#  include <fcntl.h>
+#endif
+
+namespace {
+
+// Функция очистки QImage: закрытие файла снимает его отображения
+void closeMapping(void* info)
+{
+    delete static_cast<QFile*>(info);
+}
+
+void setPbmColors(QImage& img)
+{
+    img.setColorCount(2);
+    img.setColor(0, qRgb(255, 255, 255));
+    img.setColor(1, qRgb(0, 0, 0));
+}
+
+// QImage поверх отображения [offset, offset + bpl*h) файла; файл переходит во владение изображения
+QImage wrapMapping(std::unique_ptr<QFile> file, qint64 offset, int w, int h, qsizetype bpl,
+                   QImage::Format format, QFileDevice::MemoryMapFlags flags)
+{
+    uchar* data = file->map(offset, qint64(bpl) * h, flags);
+    if (!data) return QImage();
+    QImage img(data, w, h, bpl, format, closeMapping, file.get());
+    if (img.isNull()) return QImage();   // очистка не вызывается, файл закроет unique_ptr
+    file.release();
+    if (format == QImage::Format_Mono) setPbmColors(img);
+    return img;
+}
+
+qsizetype rowBytes(Img::MappedFormat format, int width)
+{
+    return format == Img::MappedFormat::Pbm ? qsizetype(width + 7) / 8 : qsizetype(width);
+}
+
+// Длина файла с местом на диске под неё. Отображение пишет в страницы без write(),
+// и нехватку места система сообщает сигналом SIGBUS при записи в память, а не
+// ошибкой, — поэтому на Linux место резервируется заранее; в других системах
+// resize может оставить файл разреженным
+bool reserve(QFile& file, qint64 size)
+{
+    if (!file.flush()) return false;
+#if defined(Q_OS_LINUX)
+    if (posix_fallocate(file.handle(), 0, size) != 0) return false;
+#endif
+    return file.resize(size);
+}
+
+// Заголовок PGM/PBM и место под растр в открытом на запись файле; QImage поверх
+// его отображения на запись, файл переходит во владение изображения
+QImage mapNewFile(std::unique_ptr<QFile> file, Img::MappedFormat format, int width, int height)
+{
+    QByteArray header;
+    if (format == Img::MappedFormat::Pgm) header = QString("P5\n%1 %2\n255\n").arg(width).arg(height).toLatin1();
+    if (format == Img::MappedFormat::Pbm) header = QString("P4\n%1 %2\n").arg(width).arg(height).toLatin1();
+    const qsizetype bpl = rowBytes(format, width);
+    // Файл сразу нужной длины: растр отображается поверх нулей
+    if (file->write(header) != header.size() || !reserve(*file, header.size() + qint64(bpl) * height))
+        return QImage();
+    return wrapMapping(std::move(file), header.size(), width, height, bpl,
+                       format == Img::MappedFormat::Pbm ? QImage::Format_Mono : QImage::Format_Grayscale8,
+                       QFileDevice::NoOptions);
+}
+
+// Заменить path файлом tmpPath. std::rename заменяет атомарно там, где умеет
+// (POSIX); иначе — удаление и переименование
+bool replaceFile(const QString& tmpPath, const QString& path)
+{
+    if (std::rename(QFile::encodeName(tmpPath).constData(), QFile::encodeName(path).constData()) == 0)
+        return true;
+    QFile::remove(path);
+    return QFile::rename(tmpPath, path);
+}
+
+// Байт MonoLSB (бит 0 — левый пиксель, 1 — белый) -> байт PBM
+// (бит 7 — левый пиксель, 1 — чёрный): разворот битов и инверсия
+std::array<uchar, 256> makePbmTable()
+{
+    std::array<uchar, 256> t{};
+    for (int b = 0; b < 256; ++b) {
+        uchar r = 0;
+        for (int i = 0; i < 8; ++i)
+            if (b & (1 << i)) r |= uchar(0x80 >> i);
+        t[b] = uchar(~r);
+    }
+    return t;
+}
+
+} // namespace
+
+namespace Img {
+
+QImage mapImage(const QString& path)
+{
+    std::unique_ptr<QFile> file(new QFile(path));
+    PnmHeader header;
+    if (!file->open(QFile::ReadOnly) || !readPnmHeader(*file, header)) return QImage();
+    if (header.type == '5' && header.maxval != 255) return QImage();   // нужна перешкалировка
+
+    const MappedFormat format = header.type == '4' ? MappedFormat::Pbm : MappedFormat::Pgm;
+    const qsizetype bpl = rowBytes(format, header.width);
+    if (file->size() < header.dataOffset + qint64(bpl) * header.height) return QImage();
+    return wrapMapping(std::move(file), header.dataOffset, header.width, header.height, bpl,
+                       format == MappedFormat::Pbm ? QImage::Format_Mono : QImage::Format_Grayscale8,
+                       QFileDevice::MapPrivateOption);
+}
+
+QImage mapRaw(const QString& path, int width, int height)
+{
+    std::unique_ptr<QFile> file(new QFile(path));
+    if (width <= 0 || height <= 0 || !file->open(QFile::ReadOnly)
+        || file->size() < qint64(width) * height)
+        return QImage();
+    return wrapMapping(std::move(file), 0, width, height, width, QImage::Format_Grayscale8,
+                       QFileDevice::MapPrivateOption);
+}
+
+QImage createMapped(const QString& path, MappedFormat format, int width, int height)
+{
+    if (width <= 0 || height <= 0) return QImage();
+    std::unique_ptr<QFile> file(new QFile(path));
+    if (!file->open(QFile::ReadWrite | QFile::Truncate)) return QImage();
+    return mapNewFile(std::move(file), format, width, height);
+}
+
+bool saveMapped(const QImage& image, const QString& path, MappedFormat format)
+{
+    const bool pbm = format == MappedFormat::Pbm;
+    const QImage src = pbm ? packMask(image) : toGrayscale(image);
+    if (src.isNull()) return false;
+    const int w = src.width(), h = src.height();
+    if (w <= 0 || h <= 0) return false;
+
+    // Запись — во временный файл рядом, который затем подменяет path. Сам path
+    // может быть отображён (изображение открыто из него же, src смотрит в него),
+    // и усечение на месте оставило бы отображение без страниц
+    const QFileInfo info(path);
+    std::unique_ptr<QTemporaryFile> tmp(
+        new QTemporaryFile(info.absolutePath() + "/." + info.fileName() + ".XXXXXX"));
+    if (!tmp->open()) return false;
+    tmp->setAutoRemove(false);
+    tmp->setPermissions(info.exists() ? info.permissions()
+                                      : QFileDevice::ReadOwner | QFileDevice::WriteOwner
+                                            | QFileDevice::ReadGroup | QFileDevice::ReadOther);
+    const QString tmpPath = tmp->fileName();
+    {
+        QImage out = mapNewFile(std::move(tmp), format, w, h);
+        if (out.isNull()) {
+            QFile::remove(tmpPath);
+            return false;
+        }
+
+        // Строки пишутся прямо в страницы файла, полосами в несколько потоков
+        uchar* dst = out.bits();
+        const qsizetype dstBpl = out.bytesPerLine();
+        const qsizetype bytes = rowBytes(format, w);
+        static const std::array<uchar, 256> table = makePbmTable();
+        // Хвостовые биты последнего байта строки PBM — нули (белый), как требует формат
+        const uchar tailMask = (w & 7) ? uchar(0xFF << (8 - (w & 7))) : uchar(0xFF);
+        Parallel::forRange(0, h, Parallel::rowsPerBand(w), [&](int yb, int ye) {
+            for (int y = yb; y < ye; ++y) {
+                const uchar* s = src.constScanLine(y);
+                uchar* d = dst + dstBpl * y;
+                if (!pbm) {
+                    std::memcpy(d, s, size_t(bytes));
+                    continue;
+                }
+                for (qsizetype i = 0; i < bytes; ++i) d[i] = table[s[i]];
+                d[bytes - 1] &= tailMask;
+            }
+        });
+    }   // отображение снято, файл закрыт
+    if (!replaceFile(tmpPath, path)) {
+        QFile::remove(tmpPath);
+        return false;
+    }
+    return true;
+}
+
+bool saveMapped(const QImage& image, const QString& path)
+{
+    const QString suffix = QFileInfo(path).suffix().toLower();
+    if (suffix == "pgm") return saveMapped(image, path, MappedFormat::Pgm);
+    if (suffix == "pbm") return saveMapped(image, path, MappedFormat::Pbm);
+    if (suffix == "raw") return saveMapped(image, path, MappedFormat::Raw);
+    return false;
+}
+
+bool isMappedSuffix(const QString& path)
+{
+    const QString suffix = QFileInfo(path).suffix().toLower();
+    return suffix == "pgm" || suffix == "pbm" || suffix == "raw";
+}
+
+} // namespace Img
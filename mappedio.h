@@ -0,0 +1,45 @@
+#pragma once
+
+#include <QImage>
+#include <QString>
+
+// Несжатые PGM/PBM и сырые 8-битные файлы через отображение в память. QImage
+// смотрит прямо в отображение: открытие и сохранение стоят подкачки страниц, а не
+// декодирования и копирования. Отображение живёт, пока жива последняя копия
+// изображения (снимается функцией очистки QImage).
+namespace Img
+{
+
+enum class MappedFormat { Pgm, Pbm, Raw };
+
+// PGM (P5, maxval 255) -> Grayscale8, PBM (P4) -> Format_Mono (0 — белый, 1 — чёрный).
+// Отображение закрытое (copy-on-write): запись в пиксели файл не меняет, а страницы
+// копируются системой только при изменении. Пустой QImage — файл не такого формата
+// (в том числе PGM с maxval != 255) или не отображается; тогда нужен обычный QImage(path).
+QImage mapImage(const QString& path);
+
+// Сырой 8-битный растр width x height без заголовка
+QImage mapRaw(const QString& path, int width, int height);
+
+// Создать файл нужного размера и вернуть QImage поверх его отображения на запись:
+// что записано в пиксели, то и окажется в файле. Pgm/Raw — Grayscale8,
+// Pbm — Format_Mono в раскладке P4. Пустой QImage — файл не создан или на диске нет
+// места. Файл усекается на месте: path не должен быть отображён (mapImage) —
+// такие изображения после этого читают нули или падают с SIGBUS.
+// Место под растр резервируется заранее только на Linux (posix_fallocate); в других
+// системах нехватка места при записи в пиксели — сигнал SIGBUS, а не ошибка.
+QImage createMapped(const QString& path, MappedFormat format, int width, int height);
+
+// Записать изображение прямо в отображение файла: Pgm/Raw — серое (toGrayscale) построчно,
+// Pbm — маска (packMask) с разворотом битов в раскладку P4. Пишется во временный файл
+// в том же каталоге, который затем заменяет path, поэтому image может быть отображением
+// самого path. false — файл не создан, нет места (на Linux) или не удалось заменить path
+// (в Windows — если path ещё отображён). Нехватка места вне Linux — см. createMapped.
+bool saveMapped(const QImage& image, const QString& path, MappedFormat format);
+// То же с форматом по расширению .pgm/.pbm/.raw; другое расширение — false
+bool saveMapped(const QImage& image, const QString& path);
+
+// Расширение, которое понимает saveMapped(image, path)
+bool isMappedSuffix(const QString& path);
+
+} // namespace Img
@@ -0,0 +1,28 @@
+#include "maskio.h"
+#include "imageprocessor.h"
+#include "mappedio.h"
+
+#include <QFileInfo>
+#include <QImageWriter>
+
+namespace Img {
+
+bool writePbm(const QImage& mask, const QString& path)
+{
+    return saveMapped(mask, path, MappedFormat::Pbm);
+}
+
+bool saveMask(const QImage& mask, const QString& path)
+{
+    const QString suffix = QFileInfo(path).suffix().toLower();
+    if (suffix == "pbm") return writePbm(mask, path);
+
+    const QImage packed = packMask(mask);
+    if (packed.isNull()) return false;
+    QImageWriter writer(path);
+    // Для 1-битного TIFF qtiff выбирает сжатие CCITT, если сжатие вообще включено
+    if (suffix == "tif" || suffix == "tiff") writer.setCompression(1);
+    return writer.write(packed);
+}
+
+} // namespace Img
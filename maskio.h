@@ -0,0 +1,21 @@
+#pragma once
+
+#include <QImage>
+#include <QString>
+
+// Запись двоичных масок (1 бит на пиксель) для архива бинаризованных документов.
+namespace Img
+{
+
+// Сохранение маски по расширению файла; серая маска предварительно
+// упаковывается (packMask). Возвращает false при ошибке записи.
+//   .pbm        — P4 (двоичный PBM), запись в отображение файла;
+//   .tif/.tiff  — TIFF 1 бит со сжатием CCITT (плагин qtiff из Qt Image Formats);
+//   остальное   — средствами QImageWriter, PNG пишется с глубиной 1 бит.
+bool saveMask(const QImage& mask, const QString& path);
+
+// P4: строки по (w+7)/8 байт, старший бит — левый пиксель, 1 — чёрный;
+// пишется прямо в отображение файла (saveMapped)
+bool writePbm(const QImage& mask, const QString& path);
+
+} // namespace Img
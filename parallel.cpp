@@ -0,0 +1,217 @@
+#include "parallel.h"
+#include "imageprocessor.h"
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QThread>
+#include <QThreadPool>
+#include <QtGlobal>
+#include <QWaitCondition>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace {
+
+// Отдельный пул, чтобы настройка числа потоков не влияла на остальное приложение
+QThreadPool& pool()
+{
+    static QThreadPool* p = [] {
+        auto* tp = new QThreadPool;
+        tp->setMaxThreadCount(Img::threadCount());
+        return tp;
+    }();
+    return *p;
+}
+
+// 0 — по числу ядер; начальное значение можно задать переменной окружения IMGPROC_THREADS
+std::atomic<int> g_threads{qEnvironmentVariableIntValue("IMGPROC_THREADS")};
+
+// Статистика копится в вызывающем потоке (GUI, пакетный воркер и т.п. не мешают друг другу)
+thread_local Img::ParallelStats t_stats;
+
+// Отмена/прогресс операций вызывающего потока
+thread_local Img::TaskControl* t_control = nullptr;
+
+// Внутри SerialScope: проходы выполняются сразу, в вызывающем потоке
+thread_local bool t_serial = false;
+
+// Общее состояние одного прохода. Живёт в shared_ptr: помощник, запущенный пулом
+// уже после завершения всех полос, ничего не делает, но к состоянию обращается.
+struct Job {
+    const std::function<void(int, int)>* body = nullptr;
+    Img::TaskControl* control = nullptr;
+    int begin = 0, end = 0, chunk = 1, chunks = 0;
+    std::atomic<int> next{0};
+    std::atomic<int> done{0};
+    std::atomic<long long> busyNs{0};
+    QMutex mutex;
+    QWaitCondition finished;
+};
+
+bool cancelled(const Img::TaskControl* control)
+{
+    return control && control->cancelled.load(std::memory_order_relaxed);
+}
+
+// Забирать полосы, пока они есть. После отмены полосы по-прежнему забираются
+// и учитываются в done (иначе вызывающий поток не дождётся конца), но не считаются.
+void drain(Job& job)
+{
+    QElapsedTimer t;
+    t.start();
+    int processed = 0;
+    for (;;) {
+        const int c = job.next.fetch_add(1);
+        if (c >= job.chunks) break;
+        if (!cancelled(job.control)) {
+            const int b0 = job.begin + c * job.chunk;
+            const int b1 = std::min(job.end, b0 + job.chunk);
+            (*job.body)(b0, b1);
+            if (job.control) job.control->done.fetch_add(1, std::memory_order_relaxed);
+        }
+        ++processed;
+    }
+    if (processed == 0) return;
+
+    job.busyNs += t.nsecsElapsed();
+    if (job.done.fetch_add(processed) + processed == job.chunks) {
+        QMutexLocker lock(&job.mutex);
+        job.finished.wakeAll();
+    }
+}
+
+} // namespace
+
+namespace Img {
+
+void setThreadCount(int n)
+{
+    g_threads = std::max(0, n);
+    pool().setMaxThreadCount(threadCount());
+}
+
+int threadCount()
+{
+    const int n = g_threads.load();
+    return n > 0 ? n : std::max(1, QThread::idealThreadCount());
+}
+
+double ParallelStats::efficiency() const
+{
+    if (capacityMs <= 0.0) return 1.0;
+    return std::min(1.0, busyMs / capacityMs);
+}
+
+double ParallelStats::speedup() const
+{
+    return wallMs > 0.0 ? busyMs / wallMs : 1.0;
+}
+
+void resetParallelStats()
+{
+    t_stats = ParallelStats();
+}
+
+ParallelStats parallelStats()
+{
+    return t_stats;
+}
+
+double TaskControl::passProgress() const
+{
+    const int t = total.load();
+    return t > 0 ? std::min(1.0, double(done.load()) / t) : 0.0;
+}
+
+void setTaskControl(TaskControl* control)
+{
+    t_control = control;
+}
+
+TaskControl* taskControl()
+{
+    return t_control;
+}
+
+namespace Parallel {
+
+void forRange(int begin, int end, int minChunk, const std::function<void(int, int)>& body)
+{
+    if (end <= begin) return;
+    if (t_serial) {
+        body(begin, end);
+        return;
+    }
+    Img::TaskControl* control = t_control;
+    if (cancelled(control)) return;
+
+    const int threads = threadCount();
+    const int n = end - begin;
+    // Полос в несколько раз больше, чем потоков, — для балансировки неравномерной нагрузки
+    const int chunk = std::max(std::max(1, minChunk), (n + threads*4 - 1) / (threads*4));
+    const int chunks = (n + chunk - 1) / chunk;
+
+    if (control) {
+        control->done = 0;
+        control->total = chunks;
+        control->passes.fetch_add(1);
+    }
+
+    QElapsedTimer wall;
+    wall.start();
+
+    if (threads == 1 || chunks == 1) {
+        if (!control) {
+            body(begin, end);
+        } else {
+            // Под управлением TaskControl — по полосам, чтобы были прогресс и отмена
+            for (int b0 = begin; b0 < end && !cancelled(control); b0 += chunk) {
+                body(b0, std::min(end, b0 + chunk));
+                control->done.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    } else {
+        auto job = std::make_shared<Job>();
+        job->body = &body;
+        job->control = control;
+        job->begin = begin;
+        job->end = end;
+        job->chunk = chunk;
+        job->chunks = chunks;
+
+        const int helpers = std::min(threads, chunks) - 1;
+        for (int i=0; i<helpers; ++i)
+            pool().start([job] { drain(*job); });
+
+        drain(*job);
+
+        QMutexLocker lock(&job->mutex);
+        while (job->done.load() < chunks)
+            job->finished.wait(&job->mutex);
+        t_stats.busyMs += job->busyNs.load() / 1e6;
+    }
+
+    const double wallMs = wall.nsecsElapsed() / 1e6;
+    const int used = (threads == 1 || chunks == 1) ? 1 : std::min(threads, chunks);
+    if (used == 1) t_stats.busyMs += wallMs;
+    t_stats.threads = std::max(t_stats.threads, used);
+    t_stats.passes += 1;
+    t_stats.tasks += chunks;
+    t_stats.wallMs += wallMs;
+    t_stats.capacityMs += wallMs * used;
+}
+
+SerialScope::SerialScope()
+    : previous_(t_serial)
+{
+    t_serial = true;
+}
+
+SerialScope::~SerialScope()
+{
+    t_serial = previous_;
+}
+
+} // namespace Parallel
+} // namespace Img
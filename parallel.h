@@ -0,0 +1,62 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+
+// Общий параллельный исполнитель для операций Img.
+// Диапазон [begin, end) режется на полосы (обычно строки изображения), полосы
+// раздаются потокам пула по мере освобождения — поток, закончивший свою полосу,
+// сразу забирает следующую. Вызывающий поток тоже участвует в работе, поэтому
+// вложенные вызовы и занятый пул не приводят к взаимной блокировке.
+//
+// Каждая полоса пишет только в свои строки результата и читает источник целиком,
+// так что «ореолы» для окрестностей 3x3 и окна α-метода берутся прямо из
+// исходного изображения и результат совпадает с последовательным проходом.
+namespace Img {
+namespace Parallel {
+
+// Выполнить body(b0, b1) для полос, покрывающих [begin, end).
+// minChunk — минимальная длина полосы (чтобы накладные расходы не съели выигрыш).
+// Если к вызывающему потоку привязан TaskControl, перед каждой полосой проверяется
+// отмена (оставшиеся полосы пропускаются), а после — обновляется прогресс прохода.
+void forRange(int begin, int end, int minChunk, const std::function<void(int, int)>& body);
+
+// Параллельная свёртка: body(b0, b1) возвращает частичный результат полосы,
+// merge(acc, part) сливает его в общий. Порядок слияния не определён, поэтому
+// merge должен быть ассоциативным и коммутативным (целочисленные суммы, гистограммы).
+template<typename T, typename Body, typename Merge>
+T reduce(int begin, int end, int minChunk, T init, Body body, Merge merge)
+{
+    std::mutex m;
+    forRange(begin, end, minChunk, [&](int b0, int b1) {
+        T part = body(b0, b1);
+        std::lock_guard<std::mutex> lock(m);
+        merge(init, part);
+    });
+    return init;
+}
+
+// Пока объект жив, forRange в этом потоке выполняет тело сразу целиком — без пула,
+// без проверки отмены и без учёта в статистике и прогрессе. Для операций Img внутри
+// задачи, которая сама уже распараллелена (плитки Pipeline): вложенный проход
+// только раздробил бы плитку и сбил прогресс внешнего прохода.
+class SerialScope {
+public:
+    SerialScope();
+    ~SerialScope();
+    SerialScope(const SerialScope&) = delete;
+    SerialScope& operator=(const SerialScope&) = delete;
+
+private:
+    bool previous_;
+};
+
+// Минимальное число строк в полосе, чтобы полоса содержала ~64K пикселей
+inline int rowsPerBand(int width)
+{
+    return width > 0 ? std::max(1, (1 << 16) / width) : 1;
+}
+
+} // namespace Parallel
+} // namespace Img
@@ -0,0 +1,213 @@
+#include "pipeline.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Плитка — около 512 КБ исходных строк (с промежуточными этапами — порядка L2),
+// но не меньше 16 строк и не меньше ореола с двух сторон
+constexpr int kTileBytes = 1 << 19;
+constexpr int kMinTileRows = 16;
+
+// Строки [y, y + n) изображения как QImage без копирования
+QImage rowsView(const QImage& img, int y, int n)
+{
+    return QImage(img.constScanLine(y), img.width(), n, img.bytesPerLine(), img.format());
+}
+
+// Порог в буфер этапа: 255 там, где значение >= threshold (Grayscale8 или Grayscale16)
+QImage thresholdInto(const QImage& in, int threshold, QImage& buffer)
+{
+    const QImage src = (in.format() == QImage::Format_Grayscale8 || in.format() == QImage::Format_Grayscale16)
+        ? in : Img::toGrayscale(in);
+    const int w = src.width(), h = src.height();
+    if (buffer.size() != src.size() || buffer.format() != QImage::Format_Grayscale8)
+        buffer = QImage(w, h, QImage::Format_Grayscale8);
+    uchar* const base = buffer.bits();
+    const qsizetype bpl = buffer.bytesPerLine();
+    const bool wide = src.format() == QImage::Format_Grayscale16;
+    Img::Parallel::forRange(0, h, Img::Parallel::rowsPerBand(w), [&](int yb, int ye) {
+        for (int y = yb; y < ye; ++y) {
+            uchar* d = base + bpl * y;
+            if (wide) {
+                const quint16* s = reinterpret_cast<const quint16*>(src.constScanLine(y));
+                for (int x = 0; x < w; ++x) d[x] = s[x] >= threshold ? 255 : 0;
+            } else {
+                const uchar* s = src.constScanLine(y);
+                for (int x = 0; x < w; ++x) d[x] = s[x] >= threshold ? 255 : 0;
+            }
+        }
+    });
+    return buffer;
+}
+
+} // namespace
+
+namespace Img {
+
+Pipeline& Pipeline::median(int radius)
+{
+    return stage(radius, [radius](const QImage& g) { return medianFilter(g, radius); });
+}
+
+Pipeline& Pipeline::gaussian(double sigma)
+{
+    // Рекурсивный фильтр — по всему изображению: на стыках плиток его состояние
+    // расходится с проходом целиком в младшем разряде даже при ореоле в 18σ
+    return stage(gaussianRadius(sigma), [sigma](const QImage& g) { return gaussianBlur(g, sigma); }, true);
+}
+
+Pipeline& Pipeline::response(DetectorFlag which)
+{
+    stage(1, [which](const QImage& g) {
+        if (which == DetectLines) return linesResponse(g);
+        if (which == DetectPoints) return laplacianResponse(g);
+        return sobelMagnitude(g);
+    });
+    pendingResponse_ = which;
+    return *this;
+}
+
+Pipeline& Pipeline::threshold(int threshold)
+{
+    // Карта откликов сразу за детектором не нужна: детектор с порогом даёт ту же маску
+    if (pendingResponse_ != 0) {
+        const int which = pendingResponse_;
+        stages_.back().run = [which, threshold](const QImage& g, QImage&) {
+            if (which == DetectLines) return linesKernels(g, threshold);
+            if (which == DetectPoints) return pointsLaplacian(g, threshold);
+            return edgesSobel(g, threshold);
+        };
+        pendingResponse_ = 0;
+        return *this;
+    }
+    return stage({ 0, false, [threshold](const QImage& in, QImage& buffer) {
+        return thresholdInto(in, threshold, buffer); } });
+}
+
+Pipeline& Pipeline::morphology(MorphOp op, int width, int height, StructShape shape)
+{
+    // По вертикали элемент выступает от центра на height/2 строк, размыкание и замыкание — вдвое
+    const int reach = std::max(1, height) / 2;
+    const int halo = (op == MorphOp::Open || op == MorphOp::Close) ? 2 * reach : reach;
+    return stage(halo, [op, width, height, shape](const QImage& m) {
+        return Img::morphology(m, op, width, height, shape); });
+}
+
+Pipeline& Pipeline::stage(int halo, std::function<QImage(const QImage&)> fn, bool whole)
+{
+    return stage({ halo, whole, [fn](const QImage& in, QImage&) { return fn(in); } });
+}
+
+Pipeline& Pipeline::stage(Stage s)
+{
+    s.halo = std::max(0, s.halo);
+    stages_.push_back(std::move(s));
+    pendingResponse_ = 0;
+    return *this;
+}
+
+int Pipeline::halo() const
+{
+    int sum = 0;
+    for (const Stage& s : stages_) sum += s.halo;
+    return sum;
+}
+
+QImage Pipeline::run(const QImage& src, MaskFormat format) const
+{
+    if (src.isNull() || stages_.empty()) return src;
+    // Этапы whole делят конвейер на отрезки: локальные этапы между ними идут плитками
+    QImage cur = src;
+    std::vector<QImage> buffers(stages_.size());
+    for (size_t i = 0; i < stages_.size();) {
+        // Отменённый (TaskControl) этап может вернуть пустое изображение
+        if (cur.isNull()) return cur;
+        if (stages_[i].whole) {
+            cur = stages_[i].run(cur, buffers[i]);
+            ++i;
+            continue;
+        }
+        size_t j = i;
+        while (j < stages_.size() && !stages_[j].whole) ++j;
+        cur = runTiles(cur, i, j, j == stages_.size() ? format : MaskFormat::Gray8);
+        i = j;
+    }
+    return format == MaskFormat::Mono && cur.format() == QImage::Format_Grayscale8 ? packMask(cur) : cur;
+}
+
+QImage Pipeline::runTiles(const QImage& src, size_t first, size_t last, MaskFormat format) const
+{
+    const int w = src.width(), h = src.height();
+    int halo = 0;
+    for (size_t s = first; s < last; ++s) halo += stages_[s].halo;
+    // Ореол пересчитывается в каждой плитке, поэтому плитка не меньше восьми ореолов
+    const int rows = std::min(h, std::max({ kMinTileRows, kTileBytes / std::max(1, w), 8 * halo }));
+    const int tiles = (h + rows - 1) / rows;
+
+    // Плитка t: этапы подряд над строками с ореолом; offset — где внутри результата её первая строка
+    auto runTile = [&](int t, std::vector<QImage>& buffers, int& offset) {
+        const int y0 = t * rows;
+        const int top = std::max(0, y0 - halo);
+        const int bottom = std::min(h, y0 + rows + halo);
+        offset = y0 - top;
+        QImage cur = rowsView(src, top, bottom - top);
+        for (size_t s = first; s < last; ++s) cur = stages_[s].run(cur, buffers[s - first]);
+        return cur;
+    };
+
+    // Одна плитка — просто цепочка вызовов, операции распараллеливаются сами
+    std::vector<QImage> buffers(last - first);
+    int offset = 0;
+    if (tiles == 1) return runTile(0, buffers, offset);
+
+    // Формат результата — по первой плитке
+    QImage head;
+    {
+        Parallel::SerialScope serial;
+        head = runTile(0, buffers, offset);
+    }
+    const bool pack = format == MaskFormat::Mono && head.format() == QImage::Format_Grayscale8;
+    QImage out(w, h, pack ? QImage::Format_MonoLSB : head.format());
+    if (out.isNull()) return QImage();
+    if (pack) out.setColorTable({ qRgb(0, 0, 0), qRgb(255, 255, 255) });
+    else if (head.colorCount() > 0) out.setColorTable(head.colorTable());
+    uchar* const base = out.bits();
+    const qsizetype bpl = out.bytesPerLine();
+    const size_t rowBytes = (size_t(w) * out.depth() + 7) / 8;
+
+    auto store = [&](const QImage& cur, int t, int offset) {
+        const int y0 = t * rows, n = std::min(rows, h - y0);
+        const QImage inner = pack ? packMask(rowsView(cur, offset, n)) : cur;
+        const int from = pack ? 0 : offset;
+        for (int r = 0; r < n; ++r)
+            std::memcpy(base + bpl * (y0 + r), inner.constScanLine(from + r), rowBytes);
+    };
+    {
+        Parallel::SerialScope serial;
+        store(head, 0, offset);
+        head = QImage();
+    }
+
+    // Остальные плитки — потокам пула; буферы этапов живут на полосу плиток
+    Parallel::forRange(1, tiles, 1, [&](int t0, int t1) {
+        Parallel::SerialScope serial;
+        std::vector<QImage> local(last - first);
+        for (int t = t0; t < t1; ++t) {
+            int off = 0;
+            const QImage cur = runTile(t, local, off);
+            store(cur, t, off);
+        }
+    });
+    return out;
+}
+
+RegionOp Pipeline::regionOp() const
+{
+    const Pipeline copy = *this;
+    return { halo(), [copy](const QImage& g) { return copy.run(g); } };
+}
+
+} // namespace Img
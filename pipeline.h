@@ -0,0 +1,73 @@
+#pragma once
+
+#include <QImage>
+#include <functional>
+#include <vector>
+#include "imageprocessor.h"
+
+// Конвейер операций Img: этапы описываются заранее, а выполняются плитками —
+// полосами строк во всю ширину. Все этапы плитки проходят подряд, пока она
+// в кэше, поэтому цепочка «медиана -> сглаживание -> детектор -> порог -> очистка»
+// не создаёт промежуточных изображений во всё изображение и не гоняет их через
+// память. Плитки раздаются потокам пула, операции внутри плитки выполняются
+// в её потоке (Parallel::SerialScope).
+//
+// Каждый этап портит у края плитки не больше halo строк (радиус окрестности по
+// вертикали), поэтому плитка берётся с ореолом — суммой ореолов этапов — и в
+// результат идут только её внутренние строки: они совпадают с последовательным
+// вызовом тех же функций на всём изображении бит в бит. Этапы, которым нужно всё
+// изображение (нормировка Вульфа, гистерезис Канни, рекурсивный гауссов фильтр),
+// помечаются whole: они выполняются целиком и делят конвейер на отрезки, каждый
+// из которых идёт плитками.
+//
+// У этапа есть буфер, который живёт у потока между плитками: порог пишет в него,
+// и плитки одного размера память под маску не выделяют. Детектор с порогом сразу
+// за ним сливается в один этап — 16-битная карта откликов не строится вовсе.
+namespace Img {
+
+class Pipeline {
+public:
+    struct Stage {
+        int halo = 0;           // строк контекста сверху и снизу
+        bool whole = false;     // этапу нужно всё изображение
+        // Результат плитки того же размера; buffer — буфер этапа (можно вернуть его)
+        std::function<QImage(const QImage& in, QImage& buffer)> run;
+    };
+
+    // Медиана радиуса r (medianFilter)
+    Pipeline& median(int radius);
+    // Гауссово сглаживание (gaussianBlur) — этап whole: ошибки округления рекурсивного
+    // фильтра во float не затухают с расстоянием, и ни при каком ореоле плитка не
+    // совпадает с проходом целиком
+    Pipeline& gaussian(double sigma);
+    // Карта откликов детектора 3x3 (Grayscale16): DetectSobel, DetectLines или DetectPoints
+    Pipeline& response(DetectorFlag which);
+    // Порог: 255 там, где яркость или отклик >= threshold (Grayscale8). Сразу после
+    // response сливается с ним в детектор с порогом — карта откликов не строится
+    Pipeline& threshold(int threshold);
+    // Очистка маски (morphology)
+    Pipeline& morphology(MorphOp op, int width, int height, StructShape shape = StructShape::Rect);
+    // Любая операция Img: fn(плитка) -> результат того же размера
+    Pipeline& stage(int halo, std::function<QImage(const QImage&)> fn, bool whole = false);
+    Pipeline& stage(Stage s);
+
+    bool isEmpty() const { return stages_.empty(); }
+    int halo() const;
+
+    // Выполнить над src (обычно Grayscale8). Результат — формата последнего этапа;
+    // маска Grayscale8 при format = Mono упаковывается по плиткам. Пустой конвейер
+    // возвращает src; отмена (TaskControl) — недосчитанный результат.
+    QImage run(const QImage& src, MaskFormat format = MaskFormat::Gray8) const;
+
+    // Конвейер как операция processRegion (ореол — halo(), у этапов whole — их радиус)
+    RegionOp regionOp() const;
+
+private:
+    // Этапы [first, last) без whole — плитками
+    QImage runTiles(const QImage& src, size_t first, size_t last, MaskFormat format) const;
+
+    std::vector<Stage> stages_;
+    int pendingResponse_ = 0;   // последний этап — карта откликов этого детектора
+};
+
+} // namespace Img
@@ -0,0 +1,64 @@
+#include "previewcache.h"
+#include "imageprocessor.h"
+
+namespace {
+
+// Следующий уровень: серые и упакованные маски — через параллельное усреднение 2x2
+// (маска сразу становится серой, без перевода в 32 бита), остальные форматы — средствами Qt
+QImage halve(const QImage& img)
+{
+    if (img.format() == QImage::Format_Grayscale8 || img.format() == QImage::Format_MonoLSB)
+        return Img::downsample2x(img);
+    return img.scaled((img.width() + 1) / 2, (img.height() + 1) / 2,
+                      Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
+} // namespace
+
+void PreviewPyramid::setImage(const QImage& img)
+{
+    if (img.isNull()) { clear(); return; }
+    if (!levels_.empty() && img.cacheKey() == key_) return;
+    levels_.assign(1, img);
+    key_ = img.cacheKey();
+    pixmapArea_ = QSize();
+    pixmap_ = QPixmap();
+}
+
+void PreviewPyramid::clear()
+{
+    levels_.clear();
+    key_ = 0;
+    pixmapArea_ = QSize();
+    pixmap_ = QPixmap();
+}
+
+QImage PreviewPyramid::levelFor(const QSize& size)
+{
+    if (levels_.empty()) return QImage();
+    size_t i = 0;
+    for (;;) {
+        const QImage& cur = levels_[i];
+        // следующий уровень (вдвое меньше) уже не покрывает нужный размер
+        if ((cur.width() + 1) / 2 < size.width() || (cur.height() + 1) / 2 < size.height()
+            || cur.width() <= 1 || cur.height() <= 1)
+            return cur;
+        if (i + 1 == levels_.size())
+            levels_.push_back(halve(cur));
+        ++i;
+    }
+}
+
+QPixmap PreviewPyramid::pixmap(const QSize& area)
+{
+    if (levels_.empty() || area.isEmpty()) return QPixmap();
+    if (area == pixmapArea_ && !pixmap_.isNull()) return pixmap_;
+
+    const QSize fitted = levels_[0].size().scaled(area, Qt::KeepAspectRatio);
+    const QImage level = levelFor(fitted);
+    pixmap_ = QPixmap::fromImage(level.size() == fitted
+        ? level
+        : level.scaled(fitted, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+    pixmapArea_ = area;
+    return pixmap_;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <QImage>
+#include <QPixmap>
+#include <QSize>
+#include <vector>
+
+// Кэш отображения изображения в окне: пирамида уменьшенных копий (каждый уровень
+// вдвое меньше предыдущего) и готовый QPixmap под текущий размер виджета.
+// Перерисовка и изменение размера берут ближайший уровень не меньше нужного
+// размера и досглаживают только его, а не полное изображение; пересчёт —
+// только при смене картинки.
+class PreviewPyramid {
+public:
+    // Сменить изображение; та же картинка (по cacheKey) кэш не сбрасывает
+    void setImage(const QImage& img);
+    void clear();
+    bool isNull() const { return levels_.empty(); }
+
+    // Наименьший уровень, который по обеим осям не меньше size (уровни строятся по требованию)
+    QImage levelFor(const QSize& size);
+
+    // Изображение, вписанное в area с сохранением пропорций
+    QPixmap pixmap(const QSize& area);
+
+private:
+    std::vector<QImage> levels_;   // [0] — исходное изображение
+    qint64 key_ = 0;
+    QSize pixmapArea_;
+    QPixmap pixmap_;
+};
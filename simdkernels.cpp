@@ -0,0 +1,560 @@
+#include "simdkernels.h"
+#include "stencil.h"
+
+#include <QByteArray>
+#include <climits>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#  define IMG_SIMD_X86 1
+#  include <immintrin.h>
+#  if defined(_MSC_VER) && !defined(__clang__)
+#    include <intrin.h>
+#    define IMG_TARGET_AVX2
+#    define IMG_TARGET_SSE2
+#  else
+#    define IMG_TARGET_AVX2 __attribute__((target("avx2")))
+#    define IMG_TARGET_SSE2 __attribute__((target("sse2")))
+#  endif
+#endif
+
+namespace {
+
+int scalarRow(const uchar*, const uchar*, const uchar*, uchar*, int x0, int, int)
+{
+    return x0;
+}
+
+int scalarResp(const uchar*, const uchar*, const uchar*, quint16*, int x0, int)
+{
+    return x0;
+}
+
+int scalarThreshold16(const quint16*, uchar*, int, int)
+{
+    return 0;
+}
+
+int scalarFused(const uchar*, const uchar*, const uchar*, const Img::Simd::FusedRow&, int x0, int)
+{
+    return x0;
+}
+
+#ifdef IMG_SIMD_X86
+
+// Пороги переводятся в форму «строго больше», удобную для cmpgt:
+// v >= T  <=>  v > T-1. Значения откликов не превышают 2295 по модулю,
+// поэтому порог зажимаем в диапазон int16 без потери точности.
+inline short thresholdMinus1(int threshold)
+{
+    if (threshold <= 0)     return -1;
+    if (threshold > 32767)  return 32767;
+    return short(threshold - 1);
+}
+
+// Для Собеля: int(hypot(gx, gy)) >= T  <=>  gx² + gy² >= T² (T целое, T > 0).
+inline int squaredThresholdMinus1(int threshold)
+{
+    if (threshold <= 0)    return -1;
+    if (threshold > 2048)  return INT_MAX;   // |∇| не превышает 1443
+    return threshold * threshold - 1;
+}
+
+// ---------------- Векторные типы для stencil.h ----------------
+// Шаблоны stencil.h работают с векторами int16 через обычные +, − и *.
+// GCC/Clang дают эти операторы векторным расширениям (и встраивают шаблон
+// в функции с target("avx2")), для MSVC — тонкие обёртки над интринсиками.
+
+#if defined(_MSC_VER) && !defined(__clang__)
+struct I16x8  { __m128i m; };
+struct I16x16 { __m256i m; };
+
+inline I16x8 operator+(I16x8 a, I16x8 b) { return { _mm_add_epi16(a.m, b.m) }; }
+inline I16x8 operator-(I16x8 a, I16x8 b) { return { _mm_sub_epi16(a.m, b.m) }; }
+inline I16x8 operator*(I16x8 a, int k)   { return { _mm_mullo_epi16(a.m, _mm_set1_epi16(short(k))) }; }
+inline I16x16 operator+(I16x16 a, I16x16 b) { return { _mm256_add_epi16(a.m, b.m) }; }
+inline I16x16 operator-(I16x16 a, I16x16 b) { return { _mm256_sub_epi16(a.m, b.m) }; }
+inline I16x16 operator*(I16x16 a, int k)    { return { _mm256_mullo_epi16(a.m, _mm256_set1_epi16(short(k))) }; }
+
+inline __m128i raw(const I16x8& v)  { return v.m; }
+inline __m256i raw(const I16x16& v) { return v.m; }
+inline void assign(I16x8& v, __m128i m)  { v.m = m; }
+inline void assign(I16x16& v, __m256i m) { v.m = m; }
+#else
+typedef short I16x8  __attribute__((vector_size(16)));
+typedef short I16x16 __attribute__((vector_size(32)));
+
+IMG_TARGET_SSE2 inline __m128i raw(const I16x8& v)  { return reinterpret_cast<__m128i>(v); }
+IMG_TARGET_AVX2 inline __m256i raw(const I16x16& v) { return reinterpret_cast<__m256i>(v); }
+IMG_TARGET_SSE2 inline void assign(I16x8& v, __m128i m)  { v = reinterpret_cast<I16x8>(m); }
+IMG_TARGET_AVX2 inline void assign(I16x16& v, __m256i m) { v = reinterpret_cast<I16x16>(m); }
+#endif
+
+using Win8  = Img::Stencil::Window<I16x8>;    // окрестность 8 пикселей (SSE2)
+using Win16 = Img::Stencil::Window<I16x16>;   // окрестность 16 пикселей (AVX2)
+
+// ---------------- SSE2: 16 пикселей за итерацию ----------------
+
+// Столбцы x-1, x, x+1 строки row, расширенные до 16 бит: пиксели x..x+7 в lo, x+8..x+15 в hi
+IMG_TARGET_SSE2 inline void load3(const uchar* row, int x, I16x8 (&lo)[3], I16x8 (&hi)[3])
+{
+    const __m128i z = _mm_setzero_si128();
+    for (int i = 0; i < 3; ++i) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x - 1 + i));
+        assign(lo[i], _mm_unpacklo_epi8(v, z));
+        assign(hi[i], _mm_unpackhi_epi8(v, z));
+    }
+}
+
+IMG_TARGET_SSE2 inline void loadWindow(const uchar* r0, const uchar* r1, const uchar* r2, int x,
+                                       Win8& lo, Win8& hi)
+{
+    load3(r0, x, lo.v[0], hi.v[0]);
+    load3(r1, x, lo.v[1], hi.v[1]);
+    load3(r2, x, lo.v[2], hi.v[2]);
+}
+
+IMG_TARGET_SSE2 inline __m128i abs16(__m128i v)
+{
+    return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+}
+
+// Пары (gx, gy) для madd: gx² + gy² в int32
+IMG_TARGET_SSE2 inline void sobelSquares8(const Win8& n, __m128i& s0, __m128i& s1)
+{
+    I16x8 gx, gy;
+    Img::Stencil::sobel(gx, gy, n);
+    const __m128i p0 = _mm_unpacklo_epi16(raw(gx), raw(gy));
+    const __m128i p1 = _mm_unpackhi_epi16(raw(gx), raw(gy));
+    s0 = _mm_madd_epi16(p0, p0);
+    s1 = _mm_madd_epi16(p1, p1);
+}
+
+IMG_TARGET_SSE2 inline __m128i sobelMask8(const Win8& n, __m128i t2)
+{
+    __m128i s0, s1;
+    sobelSquares8(n, s0, s1);
+    return _mm_packs_epi32(_mm_cmpgt_epi32(s0, t2), _mm_cmpgt_epi32(s1, t2));
+}
+
+IMG_TARGET_SSE2 inline __m128i linesResp8(const Win8& n)
+{
+    I16x8 r[4];
+    Img::Stencil::lines(r, n);
+    return _mm_max_epi16(_mm_max_epi16(abs16(raw(r[0])), abs16(raw(r[1]))),
+                         _mm_max_epi16(abs16(raw(r[2])), abs16(raw(r[3]))));
+}
+
+IMG_TARGET_SSE2 inline __m128i linesMask8(const Win8& n, __m128i t)
+{
+    return _mm_cmpgt_epi16(linesResp8(n), t);
+}
+
+IMG_TARGET_SSE2 inline __m128i laplacianResp8(const Win8& n)
+{
+    I16x8 lap;
+    Img::Stencil::laplacian(lap, n);
+    return abs16(raw(lap));
+}
+
+IMG_TARGET_SSE2 inline __m128i laplacianMask8(const Win8& n, __m128i t)
+{
+    return _mm_cmpgt_epi16(laplacianResp8(n), t);
+}
+
+template<typename MaskFn>
+IMG_TARGET_SSE2 inline int sse2Row(const uchar* r0, const uchar* r1, const uchar* r2,
+                                   uchar* dst, int x0, int x1, __m128i t, MaskFn maskFn)
+{
+    int x = x0;
+    for (; x + 16 <= x1; x += 16) {
+        Win8 lo, hi;
+        loadWindow(r0, r1, r2, x, lo, hi);
+        const __m128i m = _mm_packs_epi16(maskFn(lo, t), maskFn(hi, t));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), m);
+    }
+    return x;
+}
+
+IMG_TARGET_SSE2 int sobelRowSse2(const uchar* r0, const uchar* r1, const uchar* r2,
+                                 uchar* dst, int x0, int x1, int threshold)
+{
+    const __m128i t2 = _mm_set1_epi32(squaredThresholdMinus1(threshold));
+    return sse2Row(r0, r1, r2, dst, x0, x1, t2, sobelMask8);
+}
+
+IMG_TARGET_SSE2 int linesRowSse2(const uchar* r0, const uchar* r1, const uchar* r2,
+                                 uchar* dst, int x0, int x1, int threshold)
+{
+    const __m128i t = _mm_set1_epi16(thresholdMinus1(threshold));
+    return sse2Row(r0, r1, r2, dst, x0, x1, t, linesMask8);
+}
+
+IMG_TARGET_SSE2 int laplacianRowSse2(const uchar* r0, const uchar* r1, const uchar* r2,
+                                     uchar* dst, int x0, int x1, int threshold)
+{
+    const __m128i t = _mm_set1_epi16(thresholdMinus1(threshold));
+    return sse2Row(r0, r1, r2, dst, x0, x1, t, laplacianMask8);
+}
+
+// Отклики без порога (8 значений int16 на регистр)
+
+// int(sqrt(gx² + gy²)): gx² + gy² < 2^24 представимо в float точно, а корень
+// в float при |∇| ≤ 1443 никогда не округляется вверх до следующего целого,
+// поэтому усечение совпадает с int(std::hypot(gx, gy)).
+IMG_TARGET_SSE2 inline __m128i sobelMag8(const Win8& n)
+{
+    __m128i s0, s1;
+    sobelSquares8(n, s0, s1);
+    const __m128i m0 = _mm_cvttps_epi32(_mm_sqrt_ps(_mm_cvtepi32_ps(s0)));
+    const __m128i m1 = _mm_cvttps_epi32(_mm_sqrt_ps(_mm_cvtepi32_ps(s1)));
+    return _mm_packs_epi32(m0, m1);
+}
+
+template<typename RespFn>
+IMG_TARGET_SSE2 inline int sse2RespRow(const uchar* r0, const uchar* r1, const uchar* r2,
+                                       quint16* dst, int x0, int x1, RespFn respFn)
+{
+    int x = x0;
+    for (; x + 16 <= x1; x += 16) {
+        Win8 lo, hi;
+        loadWindow(r0, r1, r2, x, lo, hi);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x),     respFn(lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x + 8), respFn(hi));
+    }
+    return x;
+}
+
+IMG_TARGET_SSE2 int sobelMagRowSse2(const uchar* r0, const uchar* r1, const uchar* r2,
+                                    quint16* dst, int x0, int x1)
+{
+    return sse2RespRow(r0, r1, r2, dst, x0, x1, sobelMag8);
+}
+
+IMG_TARGET_SSE2 int linesRespRowSse2(const uchar* r0, const uchar* r1, const uchar* r2,
+                                     quint16* dst, int x0, int x1)
+{
+    return sse2RespRow(r0, r1, r2, dst, x0, x1, linesResp8);
+}
+
+IMG_TARGET_SSE2 int laplacianRespRowSse2(const uchar* r0, const uchar* r1, const uchar* r2,
+                                         quint16* dst, int x0, int x1)
+{
+    return sse2RespRow(r0, r1, r2, dst, x0, x1, laplacianResp8);
+}
+
+// Порог для беззнакового 16-битного сравнения v > T-1. Крайние случаи (T ≤ 0 —
+// проходят все, T > 65535 — никто) решаются заливкой без сравнений.
+inline bool threshold16Trivial(uchar* dst, int n, int threshold)
+{
+    if (threshold <= 0)     { std::memset(dst, 255, size_t(n)); return true; }
+    if (threshold > 65535)  { std::memset(dst, 0, size_t(n));   return true; }
+    return false;
+}
+
+IMG_TARGET_SSE2 int threshold16Sse2(const quint16* src, uchar* dst, int n, int threshold)
+{
+    if (threshold16Trivial(dst, n, threshold)) return n;
+    // SSE2 сравнивает только знаковые int16: сдвигаем оба операнда на 0x8000
+    const __m128i bias = _mm_set1_epi16(short(0x8000));
+    const __m128i tb = _mm_xor_si128(_mm_set1_epi16(short(threshold - 1)), bias);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v0 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), bias);
+        const __m128i v1 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8)), bias);
+        const __m128i m = _mm_packs_epi16(_mm_cmpgt_epi16(v0, tb), _mm_cmpgt_epi16(v1, tb));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), m);
+    }
+    return i;
+}
+
+IMG_TARGET_SSE2 int fusedRowSse2(const uchar* r0, const uchar* r1, const uchar* r2,
+                                 const Img::Simd::FusedRow& out, int x0, int x1)
+{
+    const __m128i ts = _mm_set1_epi32(squaredThresholdMinus1(out.sobelThreshold));
+    const __m128i tl = _mm_set1_epi16(thresholdMinus1(out.lineThreshold));
+    const __m128i tp = _mm_set1_epi16(thresholdMinus1(out.pointThreshold));
+    int x = x0;
+    for (; x + 16 <= x1; x += 16) {
+        // окрестность загружается один раз и используется всеми детекторами
+        Win8 lo, hi;
+        loadWindow(r0, r1, r2, x, lo, hi);
+        if (out.sobel)
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out.sobel + x),
+                _mm_packs_epi16(sobelMask8(lo, ts), sobelMask8(hi, ts)));
+        if (out.lines)
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out.lines + x),
+                _mm_packs_epi16(linesMask8(lo, tl), linesMask8(hi, tl)));
+        if (out.points)
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out.points + x),
+                _mm_packs_epi16(laplacianMask8(lo, tp), laplacianMask8(hi, tp)));
+    }
+    return x;
+}
+
+// ---------------- AVX2: 32 пикселя за итерацию ----------------
+
+IMG_TARGET_AVX2 inline void widen(I16x16& v, const uchar* p)
+{
+    assign(v, _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
+}
+
+IMG_TARGET_AVX2 inline void load3(const uchar* row, int x, I16x16 (&lo)[3], I16x16 (&hi)[3])
+{
+    for (int i = 0; i < 3; ++i) {
+        widen(lo[i], row + x - 1 + i);
+        widen(hi[i], row + x + 15 + i);
+    }
+}
+
+IMG_TARGET_AVX2 inline void loadWindow(const uchar* r0, const uchar* r1, const uchar* r2, int x,
+                                       Win16& lo, Win16& hi)
+{
+    load3(r0, x, lo.v[0], hi.v[0]);
+    load3(r1, x, lo.v[1], hi.v[1]);
+    load3(r2, x, lo.v[2], hi.v[2]);
+}
+
+// unpack/packs работают внутри 128-битных половин, так что порядок пикселей сохраняется
+IMG_TARGET_AVX2 inline void sobelSquares16(const Win16& n, __m256i& s0, __m256i& s1)
+{
+    I16x16 gx, gy;
+    Img::Stencil::sobel(gx, gy, n);
+    const __m256i p0 = _mm256_unpacklo_epi16(raw(gx), raw(gy));
+    const __m256i p1 = _mm256_unpackhi_epi16(raw(gx), raw(gy));
+    s0 = _mm256_madd_epi16(p0, p0);
+    s1 = _mm256_madd_epi16(p1, p1);
+}
+
+IMG_TARGET_AVX2 inline __m256i sobelMask16(const Win16& n, __m256i t2)
+{
+    __m256i s0, s1;
+    sobelSquares16(n, s0, s1);
+    return _mm256_packs_epi32(_mm256_cmpgt_epi32(s0, t2), _mm256_cmpgt_epi32(s1, t2));
+}
+
+IMG_TARGET_AVX2 inline __m256i linesResp16(const Win16& n)
+{
+    I16x16 r[4];
+    Img::Stencil::lines(r, n);
+    return _mm256_max_epi16(_mm256_max_epi16(_mm256_abs_epi16(raw(r[0])), _mm256_abs_epi16(raw(r[1]))),
+                            _mm256_max_epi16(_mm256_abs_epi16(raw(r[2])), _mm256_abs_epi16(raw(r[3]))));
+}
+
+IMG_TARGET_AVX2 inline __m256i linesMask16(const Win16& n, __m256i t)
+{
+    return _mm256_cmpgt_epi16(linesResp16(n), t);
+}
+
+IMG_TARGET_AVX2 inline __m256i laplacianResp16(const Win16& n)
+{
+    I16x16 lap;
+    Img::Stencil::laplacian(lap, n);
+    return _mm256_abs_epi16(raw(lap));
+}
+
+IMG_TARGET_AVX2 inline __m256i laplacianMask16(const Win16& n, __m256i t)
+{
+    return _mm256_cmpgt_epi16(laplacianResp16(n), t);
+}
+
+// Две 16-битные маски по 16 пикселей -> 32 байта; packs чередует 128-битные
+// половины, permute возвращает пиксели в исходный порядок
+IMG_TARGET_AVX2 inline void storeMask32(uchar* dst, __m256i lo, __m256i hi)
+{
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst),
+                        _mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), 0xD8));
+}
+
+template<typename MaskFn>
+IMG_TARGET_AVX2 inline int avx2Row(const uchar* r0, const uchar* r1, const uchar* r2,
+                                   uchar* dst, int x0, int x1, __m256i t, MaskFn maskFn)
+{
+    int x = x0;
+    for (; x + 32 <= x1; x += 32) {
+        Win16 lo, hi;
+        loadWindow(r0, r1, r2, x, lo, hi);
+        storeMask32(dst + x, maskFn(lo, t), maskFn(hi, t));
+    }
+    return x;
+}
+
+IMG_TARGET_AVX2 int sobelRowAvx2(const uchar* r0, const uchar* r1, const uchar* r2,
+                                 uchar* dst, int x0, int x1, int threshold)
+{
+    const __m256i t2 = _mm256_set1_epi32(squaredThresholdMinus1(threshold));
+    const int x = avx2Row(r0, r1, r2, dst, x0, x1, t2, sobelMask16);
+    return sobelRowSse2(r0, r1, r2, dst, x, x1, threshold);
+}
+
+IMG_TARGET_AVX2 int linesRowAvx2(const uchar* r0, const uchar* r1, const uchar* r2,
+                                 uchar* dst, int x0, int x1, int threshold)
+{
+    const __m256i t = _mm256_set1_epi16(thresholdMinus1(threshold));
+    const int x = avx2Row(r0, r1, r2, dst, x0, x1, t, linesMask16);
+    return linesRowSse2(r0, r1, r2, dst, x, x1, threshold);
+}
+
+IMG_TARGET_AVX2 int laplacianRowAvx2(const uchar* r0, const uchar* r1, const uchar* r2,
+                                     uchar* dst, int x0, int x1, int threshold)
+{
+    const __m256i t = _mm256_set1_epi16(thresholdMinus1(threshold));
+    const int x = avx2Row(r0, r1, r2, dst, x0, x1, t, laplacianMask16);
+    return laplacianRowSse2(r0, r1, r2, dst, x, x1, threshold);
+}
+
+IMG_TARGET_AVX2 inline __m256i sobelMag16(const Win16& n)
+{
+    __m256i s0, s1;
+    sobelSquares16(n, s0, s1);
+    const __m256i m0 = _mm256_cvttps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(s0)));
+    const __m256i m1 = _mm256_cvttps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(s1)));
+    return _mm256_packs_epi32(m0, m1);
+}
+
+template<typename RespFn>
+IMG_TARGET_AVX2 inline int avx2RespRow(const uchar* r0, const uchar* r1, const uchar* r2,
+                                       quint16* dst, int x0, int x1, RespFn respFn)
+{
+    int x = x0;
+    for (; x + 32 <= x1; x += 32) {
+        Win16 lo, hi;
+        loadWindow(r0, r1, r2, x, lo, hi);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x),      respFn(lo));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x + 16), respFn(hi));
+    }
+    return x;
+}
+
+IMG_TARGET_AVX2 int sobelMagRowAvx2(const uchar* r0, const uchar* r1, const uchar* r2,
+                                    quint16* dst, int x0, int x1)
+{
+    const int x = avx2RespRow(r0, r1, r2, dst, x0, x1, sobelMag16);
+    return sobelMagRowSse2(r0, r1, r2, dst, x, x1);
+}
+
+IMG_TARGET_AVX2 int linesRespRowAvx2(const uchar* r0, const uchar* r1, const uchar* r2,
+                                     quint16* dst, int x0, int x1)
+{
+    const int x = avx2RespRow(r0, r1, r2, dst, x0, x1, linesResp16);
+    return linesRespRowSse2(r0, r1, r2, dst, x, x1);
+}
+
+IMG_TARGET_AVX2 int laplacianRespRowAvx2(const uchar* r0, const uchar* r1, const uchar* r2,
+                                         quint16* dst, int x0, int x1)
+{
+    const int x = avx2RespRow(r0, r1, r2, dst, x0, x1, laplacianResp16);
+    return laplacianRespRowSse2(r0, r1, r2, dst, x, x1);
+}
+
+IMG_TARGET_AVX2 int threshold16Avx2(const quint16* src, uchar* dst, int n, int threshold)
+{
+    if (threshold16Trivial(dst, n, threshold)) return n;
+    const __m256i bias = _mm256_set1_epi16(short(0x8000));
+    const __m256i tb = _mm256_xor_si256(_mm256_set1_epi16(short(threshold - 1)), bias);
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i v0 = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)), bias);
+        const __m256i v1 = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 16)), bias);
+        const __m256i m = _mm256_permute4x64_epi64(
+            _mm256_packs_epi16(_mm256_cmpgt_epi16(v0, tb), _mm256_cmpgt_epi16(v1, tb)), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), m);
+    }
+    return i + threshold16Sse2(src + i, dst + i, n - i, threshold);
+}
+
+IMG_TARGET_AVX2 int fusedRowAvx2(const uchar* r0, const uchar* r1, const uchar* r2,
+                                 const Img::Simd::FusedRow& out, int x0, int x1)
+{
+    const __m256i ts = _mm256_set1_epi32(squaredThresholdMinus1(out.sobelThreshold));
+    const __m256i tl = _mm256_set1_epi16(thresholdMinus1(out.lineThreshold));
+    const __m256i tp = _mm256_set1_epi16(thresholdMinus1(out.pointThreshold));
+    int x = x0;
+    for (; x + 32 <= x1; x += 32) {
+        Win16 lo, hi;
+        loadWindow(r0, r1, r2, x, lo, hi);
+        if (out.sobel)  storeMask32(out.sobel + x,  sobelMask16(lo, ts), sobelMask16(hi, ts));
+        if (out.lines)  storeMask32(out.lines + x,  linesMask16(lo, tl), linesMask16(hi, tl));
+        if (out.points) storeMask32(out.points + x, laplacianMask16(lo, tp), laplacianMask16(hi, tp));
+    }
+    return fusedRowSse2(r0, r1, r2, out, x, x1);
+}
+
+// ---------------- Определение возможностей CPU ----------------
+
+bool cpuHasSse2()
+{
+#if defined(_M_X64) || defined(__x86_64__)
+    return true;   // SSE2 входит в базовый набор x86-64
+#elif defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+bool cpuHasAvx2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx     = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx) return false;
+    if ((_xgetbv(0) & 0x6) != 0x6) return false;   // ОС сохраняет регистры XMM/YMM
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    // libgcc/compiler-rt учитывают и поддержку со стороны ОС (XCR0)
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // IMG_SIMD_X86
+
+const Img::Simd::Kernels3x3 kScalar = {
+    "scalar", scalarRow, scalarRow, scalarRow,
+    scalarResp, scalarResp, scalarResp, scalarThreshold16,
+    scalarFused
+};
+#ifdef IMG_SIMD_X86
+const Img::Simd::Kernels3x3 kSse2 = {
+    "sse2", sobelRowSse2, linesRowSse2, laplacianRowSse2,
+    sobelMagRowSse2, linesRespRowSse2, laplacianRespRowSse2, threshold16Sse2,
+    fusedRowSse2
+};
+const Img::Simd::Kernels3x3 kAvx2 = {
+    "avx2", sobelRowAvx2, linesRowAvx2, laplacianRowAvx2,
+    sobelMagRowAvx2, linesRespRowAvx2, laplacianRespRowAvx2, threshold16Avx2,
+    fusedRowAvx2
+};
+#endif
+
+const Img::Simd::Kernels3x3& selectKernels()
+{
+    const QByteArray force = qgetenv("IMGPROC_SIMD");
+    if (force == "scalar") return kScalar;
+#ifdef IMG_SIMD_X86
+    if (force != "sse2" && cpuHasAvx2()) return kAvx2;
+    if (cpuHasSse2()) return kSse2;
+#endif
+    return kScalar;
+}
+
+} // namespace
+
+namespace Img {
+namespace Simd {
+
+const Kernels3x3& kernels3x3()
+{
+    static const Kernels3x3& k = selectKernels();
+    return k;
+}
+
+} // namespace Simd
+} // namespace Img
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QtGlobal>
+
+// Векторные (SSE2/AVX2) версии детекторов 3x3.
+// Набор реализаций выбирается один раз во время выполнения по возможностям CPU;
+// скалярный путь в imageprocessor.cpp остаётся запасным вариантом.
+namespace Img {
+namespace Simd {
+
+// Обработка внутренней части строки: выходные пиксели [x0, x1),
+// r0/r1/r2 — строки y-1, y, y+1 источника, чтение идёт по столбцам x-1..x+1.
+// Возвращает первый необработанный столбец: хвост досчитывает скалярный код.
+using Row3Fn = int (*)(const uchar* r0, const uchar* r1, const uchar* r2,
+                       uchar* dst, int x0, int x1, int threshold);
+
+// То же для карт откликов: в dst пишется сам 16-битный отклик, без порога
+using Resp3Fn = int (*)(const uchar* r0, const uchar* r1, const uchar* r2,
+                        quint16* dst, int x0, int x1);
+
+// Бинаризация 16-битной карты откликов: dst[i] = src[i] >= threshold ? 255 : 0
+// для i в [0, n). Возвращает число обработанных элементов.
+using Threshold16Fn = int (*)(const quint16* src, uchar* dst, int n, int threshold);
+
+// Совмещённый проход: несколько масок по одной загрузке окрестности.
+// Нулевой указатель — маска не нужна.
+struct FusedRow {
+    uchar* sobel = nullptr;
+    uchar* lines = nullptr;
+    uchar* points = nullptr;
+    int sobelThreshold = 0;
+    int lineThreshold = 0;
+    int pointThreshold = 0;
+};
+using Fused3Fn = int (*)(const uchar* r0, const uchar* r1, const uchar* r2,
+                         const FusedRow& out, int x0, int x1);
+
+struct Kernels3x3 {
+    const char* name;      // "scalar", "sse2", "avx2"
+    Row3Fn sobel;          // |∇| >= threshold (через квадрат модуля, без sqrt)
+    Row3Fn lines;          // max |отклик| четырёх направленных ядер >= threshold
+    Row3Fn laplacian;      // |Лаплас| >= threshold
+
+    Resp3Fn sobelMagnitude;    // int(|∇|)
+    Resp3Fn linesResponse;     // max |отклик| направленных ядер
+    Resp3Fn laplacianResponse; // |Лаплас|
+    Threshold16Fn threshold16;
+
+    Fused3Fn fused;            // любые из трёх масок за один проход
+};
+
+// Лучший доступный набор для текущего процессора.
+// Переменная окружения IMGPROC_SIMD=scalar|sse2|avx2 ограничивает выбор (для сравнения и отладки).
+const Kernels3x3& kernels3x3();
+
+} // namespace Simd
+} // namespace Img
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+
+// Шаблонный движок фиксированных ядер свёртки.
+// Коэффициенты — параметры шаблона, поэтому свёртка разворачивается на этапе
+// компиляции: нулевые коэффициенты не порождают кода, ±1 превращаются в
+// сложение/вычитание, малые множители — в сложения. Сепарабельное ядро
+// сворачивается сначала по строкам, затем результаты строк — по столбцу.
+//
+// Одни и те же описания ядер работают и со скалярами (int), и с векторами int16
+// (SSE2/AVX2 в simdkernels.cpp): от типа значения нужны только +, − и умножение
+// на целое. Результат возвращается через ссылку: векторные типы шире 16 байт
+// нельзя возвращать по значению из функций без target("avx2").
+namespace Img {
+namespace Stencil {
+
+// Плотное ядро W×H, коэффициенты построчно сверху вниз
+template<int W, int H, int... C>
+struct Kernel {
+    static_assert(sizeof...(C) == std::size_t(W * H), "число коэффициентов должно быть W*H");
+    static constexpr int width = W;
+    static constexpr int height = H;
+    static constexpr std::array<int, sizeof...(C)> coeffs{{ C... }};
+
+    static constexpr int at(int j, int i) { return coeffs[std::size_t(j * W + i)]; }
+};
+
+template<int... C> using Kernel3x3 = Kernel<3, 3, C...>;
+template<int... C> using Row3      = Kernel<3, 1, C...>;   // строка 1×3
+template<int... C> using Col3      = Kernel<1, 3, C...>;   // столбец 3×1
+
+// Сепарабельное ядро Col · Row (Col — столбец H×1, Row — строка 1×W)
+template<class Col, class Row>
+struct Separable {
+    static_assert(Col::width == 1 && Row::height == 1, "Separable<столбец, строка>");
+    using ColumnKernel = Col;
+    using RowKernel = Row;
+    static constexpr int width = Row::width;
+    static constexpr int height = Col::height;
+
+    static constexpr int at(int j, int i) { return Col::at(j, 0) * Row::at(0, i); }
+};
+
+// Поэлементная проверка K == a·A + b·B (для static_assert при разложении ядер)
+template<class K, class A, class B>
+constexpr bool isCombination(int a, int b)
+{
+    if (K::width != A::width || K::height != A::height) return false;
+    if (K::width != B::width || K::height != B::height) return false;
+    for (int j = 0; j < K::height; ++j)
+        for (int i = 0; i < K::width; ++i)
+            if (K::at(j, i) != a * A::at(j, i) + b * B::at(j, i)) return false;
+    return true;
+}
+
+// K == A поэлементно
+template<class K, class A>
+constexpr bool sameKernel()
+{
+    return isCombination<K, A, A>(1, 0);
+}
+
+// Окрестность W×H, уже загруженная в значения (скаляры или векторы столбцов)
+template<class V, int W = 3, int H = 3>
+struct Window {
+    V v[H][W];
+    const V& operator()(int j, int i) const { return v[j][i]; }
+};
+
+namespace detail {
+
+template<class K> struct IsSeparable : std::false_type {};
+template<class C, class R> struct IsSeparable<Separable<C, R>> : std::true_type {};
+
+// С какого слагаемого начинать: первый положительный коэффициент
+// (тогда остальные — чистые сложения/вычитания), иначе первый ненулевой
+template<class K>
+constexpr int firstTerm()
+{
+    for (std::size_t n = 0; n < K::coeffs.size(); ++n)
+        if (K::coeffs[n] > 0) return int(n);
+    for (std::size_t n = 0; n < K::coeffs.size(); ++n)
+        if (K::coeffs[n] != 0) return int(n);
+    return int(K::coeffs.size());
+}
+
+// out = c·v
+template<int C, class V>
+inline void scale(V& out, const V& v)
+{
+    if constexpr (C == 1)       out = v;
+    else if constexpr (C == 2)  out = v + v;
+    else if constexpr (C == 3)  out = v + v + v;
+    else if constexpr (C == -1) out = V() - v;
+    else                        out = v * C;
+}
+
+// acc += c·v
+template<int C, class V>
+inline void accumulate(V& acc, const V& v)
+{
+    if constexpr (C == 0)       {}
+    else if constexpr (C == 1)  acc = acc + v;
+    else if constexpr (C == -1) acc = acc - v;
+    else if constexpr (C == 2)  acc = acc + v + v;
+    else if constexpr (C == -2) acc = acc - v - v;
+    else if constexpr (C < 0)   acc = acc - v * (-C);
+    else                        acc = acc + v * C;
+}
+
+template<class K, int F, int N, class V, class Tap>
+inline void accumulateFrom(V& acc, const Tap& tap)
+{
+    if constexpr (N < int(K::coeffs.size())) {
+        if constexpr (N != F)
+            accumulate<K::coeffs[std::size_t(N)]>(acc, tap(N / K::width, N % K::width));
+        accumulateFrom<K, F, N + 1>(acc, tap);
+    }
+}
+
+template<class K, class V, class Tap>
+inline void applyDense(V& out, const Tap& tap)
+{
+    constexpr int f = firstTerm<K>();
+    static_assert(f < int(K::coeffs.size()), "нулевое ядро");
+    scale<K::coeffs[std::size_t(f)]>(out, tap(f / K::width, f % K::width));
+    accumulateFrom<K, f, 0>(out, tap);
+}
+
+// Свёртка строк окрестности со строкой ядра; строки с нулевым весом пропускаются
+template<class Col, class Row, int J, class V, class Tap>
+inline void separableRows(V* rows, const Tap& tap)
+{
+    if constexpr (J < Col::height) {
+        if constexpr (Col::coeffs[std::size_t(J)] != 0)
+            applyDense<Row>(rows[J], [&](int, int i) -> decltype(auto) { return tap(J, i); });
+        separableRows<Col, Row, J + 1>(rows, tap);
+    }
+}
+
+template<class Col, class Row, class V, class Tap>
+inline void applySeparable(V& out, const Tap& tap)
+{
+    V rows[Col::height];
+    separableRows<Col, Row, 0>(rows, tap);
+    applyDense<Col>(out, [&](int j, int) -> const V& { return rows[j]; });
+}
+
+} // namespace detail
+
+// out = Σ K(j, i) · tap(j, i), где tap(j, i) — значение в строке j, столбце i окрестности
+template<class K, class V, class Tap>
+inline void apply(V& out, const Tap& tap)
+{
+    if constexpr (detail::IsSeparable<K>::value)
+        detail::applySeparable<typename K::ColumnKernel, typename K::RowKernel>(out, tap);
+    else
+        detail::applyDense<K>(out, tap);
+}
+
+// ---------------- Ядра детекторов ----------------
+
+namespace Kernels {
+
+// Собель: сепарабельная форма и проверка совпадения с классической матрицей
+using SobelX = Separable<Col3<1, 2, 1>, Row3<-1, 0, 1>>;
+using SobelY = Separable<Col3<-1, 0, 1>, Row3<1, 2, 1>>;
+static_assert(sameKernel<SobelX, Kernel3x3<-1,0,1, -2,0,2, -1,0,1>>(), "SobelX");
+static_assert(sameKernel<SobelY, Kernel3x3<-1,-2,-1, 0,0,0, 1,2,1>>(), "SobelY");
+
+// Линии: гориз., верт., диагонали
+using LineH    = Kernel3x3<-1,-1,-1,  2, 2, 2, -1,-1,-1>;
+using LineV    = Kernel3x3<-1, 2,-1, -1, 2,-1, -1, 2,-1>;
+using LineD45  = Kernel3x3< 2,-1,-1, -1, 2,-1, -1,-1, 2>;
+using LineD135 = Kernel3x3<-1,-1, 2, -1, 2,-1,  2,-1,-1>;
+
+// Каждое ядро линии = 3·(индикатор своей линии) − (сумма окрестности):
+// сумма окрестности считается один раз на все четыре направления
+using Ones      = Separable<Col3<1, 1, 1>, Row3<1, 1, 1>>;
+using OnLineH   = Kernel3x3<0,0,0, 1,1,1, 0,0,0>;
+using OnLineV   = Kernel3x3<0,1,0, 0,1,0, 0,1,0>;
+using OnLine45  = Kernel3x3<1,0,0, 0,1,0, 0,0,1>;
+using OnLine135 = Kernel3x3<0,0,1, 0,1,0, 1,0,0>;
+static_assert(isCombination<LineH,    OnLineH,   Ones>(3, -1), "LineH");
+static_assert(isCombination<LineV,    OnLineV,   Ones>(3, -1), "LineV");
+static_assert(isCombination<LineD45,  OnLine45,  Ones>(3, -1), "LineD45");
+static_assert(isCombination<LineD135, OnLine135, Ones>(3, -1), "LineD135");
+
+// Классический Лаплас (8-соседство)
+using Laplace = Kernel3x3<-1,-1,-1, -1,8,-1, -1,-1,-1>;
+
+} // namespace Kernels
+
+// Градиент Собеля
+template<class V, class Tap>
+inline void sobel(V& gx, V& gy, const Tap& tap)
+{
+    apply<Kernels::SobelX>(gx, tap);
+    apply<Kernels::SobelY>(gy, tap);
+}
+
+// Знаковые отклики четырёх ядер линий (H, V, 45°, 135°)
+template<class V, class Tap>
+inline void lines(V (&resp)[4], const Tap& tap)
+{
+    V sum, on[4];
+    apply<Kernels::Ones>(sum, tap);
+    apply<Kernels::OnLineH>(on[0], tap);
+    apply<Kernels::OnLineV>(on[1], tap);
+    apply<Kernels::OnLine45>(on[2], tap);
+    apply<Kernels::OnLine135>(on[3], tap);
+    for (int k = 0; k < 4; ++k) {
+        detail::scale<3>(resp[k], on[k]);
+        resp[k] = resp[k] - sum;
+    }
+}
+
+// Лапласиан
+template<class V, class Tap>
+inline void laplacian(V& out, const Tap& tap)
+{
+    apply<Kernels::Laplace>(out, tap);
+}
+
+} // namespace Stencil
+} // namespace Img
@@ -0,0 +1,294 @@
+#include "stream.h"
+#include "imageprocessor.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+
+namespace {
+
+// Полоса строк из буфера как QImage, без копирования
+QImage stripView(const std::vector<uchar>& buf, int width, int rows)
+{
+    return QImage(buf.data(), width, rows, width, QImage::Format_Grayscale8);
+}
+
+bool cancelled()
+{
+    const Img::TaskControl* control = Img::taskControl();
+    return control && control->isCancelled();
+}
+
+// Глобальные методы: гистограмма складывается по полосам, затем второй проход с порогом
+bool streamGlobal(Img::StripSource& src, Img::StripSink& dst, const Img::StreamOp& op, int stripRows)
+{
+    const int w = src.width(), h = src.height();
+    std::vector<uchar> buf(size_t(stripRows) * w);
+
+    std::array<qint64, 256> hist{};
+    for (int y = 0; y < h; y += stripRows) {
+        const int n = std::min(stripRows, h - y);
+        if (cancelled() || !src.read(buf.data(), w, n)) return false;
+        const Img::ImageStats part = Img::ImageStats::compute(stripView(buf, w, n));
+        for (int i = 0; i < 256; ++i) hist[i] += part.hist[i];
+    }
+    const Img::ImageStats stats = Img::ImageStats::fromHistogram(hist);
+
+    if (!src.rewind()) return false;
+    for (int y = 0; y < h; y += stripRows) {
+        const int n = std::min(stripRows, h - y);
+        if (cancelled() || !src.read(buf.data(), w, n)) return false;
+        const QImage strip = stripView(buf, w, n);
+        QImage out;
+        switch (op.kind) {
+        case Img::StreamOp::Mean:      out = Img::thresholdMean(strip, stats); break;
+        case Img::StreamOp::Iterative: out = Img::thresholdIterative(strip, stats); break;
+        default:                       out = Img::thresholdOtsu(strip, stats); break;
+        }
+        if (!dst.write(out.constBits(), out.bytesPerLine(), n)) return false;
+    }
+    return true;
+}
+
+// Детекторы 3x3: в буфере полоса и по строке над и под ней. Соседние строки
+// с краёв полосы настоящие, а на краях изображения детектор сам отражает
+// границу — как при обработке изображения целиком.
+bool streamDetector(Img::StripSource& src, Img::StripSink& dst, const Img::StreamOp& op, int stripRows)
+{
+    const int w = src.width(), h = src.height();
+    std::vector<uchar> buf(size_t(stripRows + 2) * w);
+    int top = 0;    // строка изображения в начале буфера
+    int have = 0;   // строк в буфере
+
+    for (int y0 = 0; y0 < h; y0 += stripRows) {
+        const int y1 = std::min(h, y0 + stripRows);
+        const int from = std::max(0, y0 - 1);
+        const int to = std::min(h, y1 + 1);
+
+        // строки прошлой полосы, которые ещё нужны, — в начало буфера
+        const int keep = std::max(0, top + have - from);
+        if (keep > 0)
+            std::memmove(buf.data(), buf.data() + size_t(from - top) * w, size_t(keep) * w);
+        top = from;
+        have = keep;
+        if (cancelled() || !src.read(buf.data() + size_t(have) * w, w, to - top - have)) return false;
+        have = to - top;
+
+        const QImage strip = stripView(buf, w, have);
+        QImage out;
+        switch (op.kind) {
+        case Img::StreamOp::Lines:  out = Img::linesKernels(strip, op.threshold); break;
+        case Img::StreamOp::Points: out = Img::pointsLaplacian(strip, op.threshold); break;
+        default:                    out = Img::edgesSobel(strip, op.threshold); break;
+        }
+        if (!dst.write(out.constScanLine(y0 - top), out.bytesPerLine(), y1 - y0)) return false;
+    }
+    return true;
+}
+
+bool streamAlpha(Img::StripSource& src, Img::StripSink& dst, const Img::StreamOp& op, int stripRows)
+{
+    const int w = src.width(), h = src.height();
+    std::vector<uchar> buf(size_t(stripRows) * w);
+    Img::AlphaStream alpha(w, h, op.windowSize, op.alpha);
+    bool ok = true;
+    for (int y = 0; y < h && ok; y += stripRows) {
+        const int n = std::min(stripRows, h - y);
+        if (cancelled() || !src.read(buf.data(), w, n)) return false;
+        alpha.push(buf.data(), w, n, [&](int, const uchar* row) {
+            ok = ok && dst.write(row, w, 1);
+        });
+    }
+    return ok;
+}
+
+// Лексема заголовка PNM; комментарии '#' до конца строки пропускаются
+bool readPnmToken(QIODevice& dev, QByteArray& token)
+{
+    token.clear();
+    char c = 0;
+    for (;;) {
+        if (!dev.getChar(&c)) return false;
+        if (c == '#') {
+            while (dev.getChar(&c) && c != '\n') {}
+            continue;
+        }
+        if (!std::isspace(uchar(c))) break;
+    }
+    token.append(c);
+    while (dev.getChar(&c)) {
+        if (std::isspace(uchar(c))) return true;   // ровно один пробел после лексемы
+        token.append(c);
+    }
+    return true;
+}
+
+} // namespace
+
+namespace Img {
+
+// ---------------- Заголовок PNM ----------------
+
+bool readPnmHeader(QIODevice& dev, PnmHeader& header)
+{
+    QByteArray token;
+    if (!readPnmToken(dev, token) || token.size() != 2 || token[0] != 'P') return false;
+    header.type = token[1];
+    if (header.type != '4' && header.type != '5') return false;
+
+    bool okW = false, okH = false, okM = true;
+    if (!readPnmToken(dev, token)) return false;
+    header.width = token.toInt(&okW);
+    if (!readPnmToken(dev, token)) return false;
+    header.height = token.toInt(&okH);
+    header.maxval = 1;
+    if (header.type == '5') {
+        if (!readPnmToken(dev, token)) return false;
+        header.maxval = token.toInt(&okM);
+    }
+    if (!okW || !okH || !okM || header.width <= 0 || header.height <= 0
+        || header.maxval <= 0 || header.maxval > 255)
+        return false;
+    header.dataOffset = dev.pos();
+    return true;
+}
+
+// ---------------- Файлы ----------------
+
+std::unique_ptr<FileStripSource> FileStripSource::openPgm(const QString& path)
+{
+    std::unique_ptr<FileStripSource> src(new FileStripSource);
+    src->file_.setFileName(path);
+    PnmHeader header;
+    if (!src->file_.open(QFile::ReadOnly) || !readPnmHeader(src->file_, header) || header.type != '5')
+        return nullptr;
+    src->width_ = header.width;
+    src->height_ = header.height;
+    src->dataOffset_ = header.dataOffset;
+    return src;
+}
+
+std::unique_ptr<FileStripSource> FileStripSource::openRaw(const QString& path, int width, int height)
+{
+    std::unique_ptr<FileStripSource> src(new FileStripSource);
+    src->file_.setFileName(path);
+    if (width <= 0 || height <= 0 || !src->file_.open(QFile::ReadOnly)
+        || src->file_.size() < qint64(width) * height)
+        return nullptr;
+    src->width_ = width;
+    src->height_ = height;
+    return src;
+}
+
+bool FileStripSource::read(uchar* dst, qsizetype bpl, int rows)
+{
+    if (bpl == width_) {
+        const qint64 bytes = qint64(width_) * rows;
+        return file_.read(reinterpret_cast<char*>(dst), bytes) == bytes;
+    }
+    for (int r = 0; r < rows; ++r)
+        if (file_.read(reinterpret_cast<char*>(dst + bpl * r), width_) != width_) return false;
+    return true;
+}
+
+bool FileStripSource::rewind()
+{
+    return file_.seek(dataOffset_);
+}
+
+std::unique_ptr<FileStripSink> FileStripSink::create(const QString& path, Format format, int width, int height)
+{
+    std::unique_ptr<FileStripSink> dst(new FileStripSink);
+    dst->file_.setFileName(path);
+    dst->format_ = format;
+    dst->width_ = width;
+    if (width <= 0 || height <= 0 || !dst->file_.open(QFile::WriteOnly | QFile::Truncate))
+        return nullptr;
+
+    QByteArray header;
+    if (format == Pgm) header = QString("P5\n%1 %2\n255\n").arg(width).arg(height).toLatin1();
+    if (format == Pbm) header = QString("P4\n%1 %2\n").arg(width).arg(height).toLatin1();
+    if (dst->file_.write(header) != header.size()) return nullptr;
+    if (format == Pbm) dst->row_.resize(size_t(width + 7) / 8);
+    return dst;
+}
+
+bool FileStripSink::write(const uchar* src, qsizetype bpl, int rows)
+{
+    for (int r = 0; r < rows; ++r) {
+        const uchar* s = src + bpl * r;
+        if (format_ != Pbm) {
+            if (file_.write(reinterpret_cast<const char*>(s), width_) != width_) return false;
+            continue;
+        }
+        // P4: старший бит — левый пиксель, 1 — чёрный
+        std::fill(row_.begin(), row_.end(), uchar(0));
+        for (int x = 0; x < width_; ++x)
+            if (s[x] < 128) row_[x >> 3] |= uchar(0x80 >> (x & 7));
+        const qint64 bytes = qint64(row_.size());
+        if (file_.write(reinterpret_cast<const char*>(row_.data()), bytes) != bytes) return false;
+    }
+    return true;
+}
+
+bool FileStripSink::finish()
+{
+    if (!file_.flush()) return false;
+    file_.close();
+    return file_.error() == QFile::NoError;
+}
+
+// ---------------- Изображения в памяти ----------------
+
+ImageStripSource::ImageStripSource(const QImage& gray)
+    : gray_(gray)
+{
+    width_ = gray.width();
+    height_ = gray.height();
+}
+
+bool ImageStripSource::read(uchar* dst, qsizetype bpl, int rows)
+{
+    if (next_ + rows > height_) return false;
+    for (int r = 0; r < rows; ++r)
+        std::memcpy(dst + bpl * r, gray_.constScanLine(next_ + r), size_t(width_));
+    next_ += rows;
+    return true;
+}
+
+ImageStripSink::ImageStripSink(int width, int height)
+    : image_(width, height, QImage::Format_Grayscale8)
+{
+}
+
+bool ImageStripSink::write(const uchar* src, qsizetype bpl, int rows)
+{
+    if (next_ + rows > image_.height()) return false;
+    for (int r = 0; r < rows; ++r)
+        std::memcpy(image_.scanLine(next_ + r), src + bpl * r, size_t(image_.width()));
+    next_ += rows;
+    return true;
+}
+
+// ---------------- Потоковая обработка ----------------
+
+bool processStream(StripSource& src, StripSink& dst, const StreamOp& op, int stripRows)
+{
+    if (src.width() <= 0 || src.height() <= 0) return false;
+    stripRows = std::max(1, stripRows);
+
+    bool ok = false;
+    switch (op.kind) {
+    case StreamOp::Otsu:
+    case StreamOp::Mean:
+    case StreamOp::Iterative: ok = streamGlobal(src, dst, op, stripRows); break;
+    case StreamOp::Alpha:     ok = streamAlpha(src, dst, op, stripRows); break;
+    case StreamOp::Sobel:
+    case StreamOp::Lines:
+    case StreamOp::Points:    ok = streamDetector(src, dst, op, stripRows); break;
+    }
+    return dst.finish() && ok;
+}
+
+} // namespace Img
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <QFile>
+#include <QImage>
+#include <QString>
+#include <memory>
+#include <vector>
+
+// Потоковая обработка изображений, которые не помещаются в память (гигапиксельные
+// сканы, аэрофотоснимки). Изображение читается полосами строк сверху вниз, операция
+// держит только нужные ей строки, а результат пишется полосами по мере готовности:
+// память зависит от ширины, высоты полосы и окна операции, но не от высоты изображения.
+namespace Img
+{
+
+// ---------------- ИСТОЧНИКИ И ПРИЁМНИКИ ПОЛОС ----------------
+
+// Источник строк 8-битного серого изображения, читается строго сверху вниз
+class StripSource {
+public:
+    virtual ~StripSource() = default;
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    // Следующие rows строк в dst с шагом bpl; false — ошибка чтения
+    virtual bool read(uchar* dst, qsizetype bpl, int rows) = 0;
+    // Вернуться к первой строке (для двухпроходных операций)
+    virtual bool rewind() = 0;
+
+protected:
+    int width_ = 0;
+    int height_ = 0;
+};
+
+// Приёмник строк результата (Grayscale8, маски — 255/0), строго сверху вниз
+class StripSink {
+public:
+    virtual ~StripSink() = default;
+    virtual bool write(const uchar* src, qsizetype bpl, int rows) = 0;
+    // Дописать буферы и закрыть; false — ошибка записи
+    virtual bool finish() { return true; }
+};
+
+// Заголовок PNM: P4 (PBM) или P5 (PGM, maxval <= 255)
+struct PnmHeader {
+    char type = 0;          // '4' или '5'
+    int width = 0;
+    int height = 0;
+    int maxval = 1;
+    qint64 dataOffset = 0;  // начало растра в файле
+};
+bool readPnmHeader(QIODevice& dev, PnmHeader& header);
+
+// Файл PGM (P5, 8 бит) или сырой 8-битный дамп без заголовка
+class FileStripSource : public StripSource {
+public:
+    static std::unique_ptr<FileStripSource> openPgm(const QString& path);
+    static std::unique_ptr<FileStripSource> openRaw(const QString& path, int width, int height);
+
+    bool read(uchar* dst, qsizetype bpl, int rows) override;
+    bool rewind() override;
+
+private:
+    QFile file_;
+    qint64 dataOffset_ = 0;
+};
+
+// Файл результата: PGM (P5), PBM (P4, яркость < 128 — чёрный) или сырой дамп
+class FileStripSink : public StripSink {
+public:
+    enum Format { Pgm, Pbm, Raw };
+    static std::unique_ptr<FileStripSink> create(const QString& path, Format format, int width, int height);
+
+    bool write(const uchar* src, qsizetype bpl, int rows) override;
+    bool finish() override;
+
+private:
+    QFile file_;
+    Format format_ = Pgm;
+    int width_ = 0;
+    std::vector<uchar> row_;   // упакованная строка PBM
+};
+
+// Изображение в памяти как источник и приёмник (проверка, небольшие изображения)
+class ImageStripSource : public StripSource {
+public:
+    explicit ImageStripSource(const QImage& gray);
+    bool read(uchar* dst, qsizetype bpl, int rows) override;
+    bool rewind() override { next_ = 0; return true; }
+
+private:
+    QImage gray_;
+    int next_ = 0;
+};
+
+class ImageStripSink : public StripSink {
+public:
+    ImageStripSink(int width, int height);
+    bool write(const uchar* src, qsizetype bpl, int rows) override;
+    QImage image() const { return image_; }
+
+private:
+    QImage image_;
+    int next_ = 0;
+};
+
+// ---------------- ПОТОКОВЫЕ ОПЕРАЦИИ ----------------
+
+struct StreamOp {
+    enum Kind { Otsu, Mean, Iterative, Alpha, Sobel, Lines, Points };
+    Kind kind = Otsu;
+    int windowSize = 25;    // α-метод
+    double alpha = 0.67;    // α-метод
+    int threshold = 100;    // детекторы
+};
+
+// Обработать src полосами по stripRows строк и записать результат в dst.
+// Результат совпадает с операцией над изображением целиком.
+//   глобальные методы — два прохода: гистограмма по полосам, затем порог;
+//   детекторы 3x3    — полоса плюс по строке сверху и снизу;
+//   α-метод          — AlphaStream: N строк окна и столбцовые суммы.
+// Отмена через TaskControl проверяется между полосами. false — ошибка
+// чтения/записи или отмена.
+bool processStream(StripSource& src, StripSink& dst, const StreamOp& op, int stripRows = 256);
+
+} // namespace Img